@@ -163,56 +163,64 @@ Section* deleteSection(Section* head, char name[])
 }
 
 // --- Sorting Function ---
-void sortBooks(Section* sec, int criteria, int ascending) {
-    if (!sec || !sec->books) return;
+// Stable merge sort that relinks `next` pointers; book data never moves,
+// so pointers to a Book stay valid across a sort.
 
-    Book* i;
-    Book* j;
-
-    for (i = sec->books; i != NULL; i = i->next) {
-        for (j = i->next; j != NULL; j = j->next) {
-            int swap = 0;
-
-            if (criteria == 1) { // Sort by ID
-                if (ascending)
-                    swap = i->id > j->id;
-                else
-                    swap = i->id < j->id;
-            } 
-            else if (criteria == 2) { // Sort by Title
-                if (ascending)
-                    swap = strcmp(i->title, j->title) > 0;
-                else
-                    swap = strcmp(i->title, j->title) < 0;
-            } 
-            else if (criteria == 3) { // Sort by Author
-                if (ascending)
-                    swap = strcmp(i->author, j->author) > 0;
-                else
-                    swap = strcmp(i->author, j->author) < 0;
-            }
+// <0 if a should come before b, >0 if after, 0 if equal for this criteria
+static int compareBooks(Book* a, Book* b, int criteria, int ascending) {
+    int cmp = 0;
 
-            if (swap) {
-                // Swap all book data except next pointer
-                int tempID = i->id;
-                char tempTitle[50], tempAuthor[50];
-                int tempIssued = i->isIssued;
+    if (criteria == 1) // Sort by ID
+        cmp = (a->id > b->id) - (a->id < b->id);
+    else if (criteria == 2) // Sort by Title
+        cmp = strcmp(a->title, b->title);
+    else if (criteria == 3) // Sort by Author
+        cmp = strcmp(a->author, b->author);
 
-                strcpy(tempTitle, i->title);
-                strcpy(tempAuthor, i->author);
-
-                i->id = j->id;
-                strcpy(i->title, j->title);
-                strcpy(i->author, j->author);
-                i->isIssued = j->isIssued;
+    return ascending ? cmp : -cmp;
+}
 
-                j->id = tempID;
-                strcpy(j->title, tempTitle);
-                strcpy(j->author, tempAuthor);
-                j->isIssued = tempIssued;
-            }
+static Book* mergeBooks(Book* a, Book* b, int criteria, int ascending) {
+    Book* head = NULL;
+    Book** tail = &head;
+
+    while (a && b) {
+        // Take from the left run on ties to keep the sort stable
+        if (compareBooks(a, b, criteria, ascending) <= 0) {
+            *tail = a;
+            a = a->next;
+        } else {
+            *tail = b;
+            b = b->next;
         }
+        tail = &(*tail)->next;
     }
+    *tail = a ? a : b;
+    return head;
+}
+
+static Book* mergeSortBooks(Book* head, int criteria, int ascending) {
+    if (!head || !head->next) return head;
+
+    // Split the list in half with slow/fast pointers
+    Book* slow = head;
+    Book* fast = head->next;
+    while (fast && fast->next) {
+        slow = slow->next;
+        fast = fast->next->next;
+    }
+    Book* right = slow->next;
+    slow->next = NULL;
+
+    return mergeBooks(mergeSortBooks(head, criteria, ascending),
+                      mergeSortBooks(right, criteria, ascending),
+                      criteria, ascending);
+}
+
+void sortBooks(Section* sec, int criteria, int ascending) {
+    if (!sec || !sec->books) return;
+
+    sec->books = mergeSortBooks(sec->books, criteria, ascending);
 
     printf("Books in section '%s' sorted successfully!\n", sec->name);
 }
@@ -3,232 +3,6134 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+#include <strings.h>
 
 // --- Structures ---
+
+// Book and Section nodes come from slab arenas instead of one malloc each.
+// A slab is a SLAB_SIZE block aligned to its own size, so the slab owning
+// any node is found by masking the node's address.
+#define SLAB_SIZE (64 * 1024)
+
+struct Arena;
+
+typedef struct Slab
+{
+    struct Arena* arena;  // owning arena, NULL once orphaned
+    struct Slab* next;
+    size_t live;          // nodes handed out and not yet freed
+    size_t lent;          // live nodes currently owned by another section
+                          // (both updated atomically: other sections free
+                          // and adopt nodes without the owner's lock)
+} Slab;
+
+typedef struct Arena
+{
+    size_t objSize;       // size class served by this arena
+    Slab* slabs;          // slabs[0] is the one being carved
+    char* bump;
+    char* end;
+    void* freeList;       // freed nodes, reused before carving more
+    void* remoteFree;     // nodes freed by other sections, pushed atomically
+} Arena;
+
+// Book nodes are the cold part of a record. The ID and availability
+// that lookups check live in the owning section's hot columns instead.
+// A node is a title: every copy of one ID within a section shares it,
+// and the columns count the copies and how many are on the shelf.
 typedef struct Book 
 {
     int id;
+    int col;          // position in the section's hot columns
+    uint32_t textRec; // record in the substring-scan text arena
     char title[50];
     char author[50];
-    int isIssued; // 0 = available, 1 = issued
+    struct Book* prev;
     struct Book* next;
+    struct SkipTower* tower;  // skip list links above `next`, ordered
+                              // sections only; NULL = none
 } Book;
 
+// Forward links of a skip list node on levels 1 and up; level 0 is the
+// section's book list itself
+typedef struct SkipTower
+{
+    int height;             // levels including level 0
+    struct Book* next[];
+} SkipTower;
+
+// Copies of a title held by a section and how many are not issued.
+// Only kept for titles with more than one copy.
+typedef struct Stock
+{
+    int copies;
+    int onShelf;            // updated atomically
+} Stock;
+
+// Status of 64 columns, kept side by side so both share a cache line
+typedef struct ColumnBits
+{
+    uint64_t available;     // bit set = some copy is on the shelf
+    uint64_t multiCopy;     // bit set = several copies, counted in stock
+} ColumnBits;
+
 typedef struct Section 
 {
     char name[50];
+    unsigned int hash;      // precomputed hash of name
+    size_t nameLen;
     Book* books;
+    Arena arena;            // per-section arena holding its books
+    // Hot columns, one entry per title (order unrelated to the list)
+    int* ids;
+    ColumnBits* bits;       // one entry per 64 columns
+    Stock* stock;
+    Book** nodes;           // column -> cold record
+    int count;              // titles in the section
+    int capacity;
+    int copyCount;          // copies of all titles together
+    int issued;             // copies currently issued (updated atomically)
+    SkipTower* skip;        // ordered sections: level heads of the skip
+                            // list over `books`; NULL = unordered
+    pthread_rwlock_t lock;  // guards the list, columns and arena above
+    struct Section* older;  // earlier section with the same name, if any
+    struct Section* prev;
     struct Section* next;
 } Section;
 
+// Library-wide index entry: where a book ID lives. There is one entry
+// per title, so an ID only repeats when copies sit in several sections.
+typedef struct BookSlot
+{
+    int id;
+    int col;          // the book's column in section, so status checks
+                      // never have to touch the Book node
+    Book* book;       // NULL = empty slot
+    Section* section; // section currently holding the book
+    uint32_t loan;    // newest open loan's table slot + 1, 0 = none
+} BookSlot;
+
+typedef struct BookIndex
+{
+    BookSlot* slots;
+    size_t capacity;  // always a power of two
+    size_t count;
+} BookIndex;
+
+static BookIndex bookIndex;
+
+// Section directory: hashed names -> newest Section with that name.
+// addSection refuses a name in use; only snapshots written before that
+// can still hold two sections with one name.
+typedef struct SectionSlot
+{
+    unsigned int hash;
+    Section* section; // NULL = empty slot
+} SectionSlot;
+
+typedef struct SectionDirectory
+{
+    SectionSlot* slots;
+    size_t capacity;  // always a power of two
+    size_t count;
+} SectionDirectory;
+
+static SectionDirectory sectionDir;
+
+// Library-wide counters, kept current by every mutation
+typedef struct LibraryStats
+{
+    long sections;
+    long books;       // copies
+    long issued;
+} LibraryStats;
+
+static LibraryStats stats;
+
+// Who has an issued copy and until when
+typedef struct Loan
+{
+    Book* book;           // title of the copy, NULL = free slot
+    uint32_t older;       // next loan on the same title, slot + 1
+    char borrower[50];
+    time_t issuedAt;
+    time_t dueAt;
+} Loan;
+
+// Outcome of a bulk CSV import
+typedef struct ImportReport
+{
+    long rows;        // books imported, -1 if the file couldn't be read
+    long rejected;    // malformed rows skipped
+    long sections;    // distinct sections the rows went to
+    int threads;
+    double parseSecs;
+    double linkSecs;
+    double indexSecs;
+} ImportReport;
+
+// The catalog is process-wide; `head` arguments are kept for API
+// compatibility and this is the list they refer to.
+static Section* sectionList;
+
+// --- Locking ---
+// Several desk threads may use the catalog at once. Locks are always
+// taken in this order, so no two threads can wait on each other:
+//   catalogLock   write: addSection/deleteSection/snapshots; read: the rest
+//   Section.lock  at most two at a time, lower address first
+//   indexLock     book index, text indexes and hot-column reallocation
+//   loan stripe   at most one; loans and holds of the IDs hashed to it
+//   walSyncLock   writing and fsyncing a group of log records
+//   walLock, slabLock (leaves)
+// Issue and return take no section or index lock exclusively: holding
+// catalogLock and indexLock for reading, they claim a copy with a
+// compare-and-swap on the title's availability word (or on-shelf count)
+// and update its loan under the ID's loan stripe. No lock is shared by
+// every desk: walLock is held only to copy a record into the log buffer,
+// never across a write or fsync. On-shelf counts, Section.issued and
+// stats.issued are always updated atomically; the other counters follow
+// catalogLock/indexLock. Loans and holds only change under catalogLock,
+// so holding it for writing is enough to walk every stripe.
+static pthread_rwlock_t catalogLock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_rwlock_t indexLock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t walLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t slabLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void lockSectionPair(Section* a, Section* b)
+{
+    if((uintptr_t)a > (uintptr_t)b) {
+        Section* t = a;
+        a = b;
+        b = t;
+    }
+    pthread_rwlock_wrlock(&a->lock);
+    if(b != a)
+        pthread_rwlock_wrlock(&b->lock);
+}
+
+static void unlockSectionPair(Section* a, Section* b)
+{
+    if(b != a)
+        pthread_rwlock_unlock(&b->lock);
+    pthread_rwlock_unlock(&a->lock);
+}
+
 // --- Function Prototypes ---
 Section* addSection(Section* head, char name[]);
 Section* findSection(Section* head, char name[]);
 void displaySections(Section* head);
+void sortBooks(Section* sec, int criteria, int ascending);
+void orderSection(Section* sec);
+size_t booksInRange(Section* sec, int lo, int hi, int (*visit)(Book*, void*), void* ctx);
+void displayRange(Section* sec, int lo, int hi);
+size_t catalogRange(int lo, int hi, int (*visit)(Book*, Section*, void*), void* ctx);
+void displayCatalogRange(int lo, int hi);
 void addBook(Section* sec, int id, char title[], char author[]);
 void displayBooks(Section* sec);
+void displayAvailableBooks(Section* sec);
+int countAvailable(Section* sec);
+void searchPrefix(int field, const char* prefix, int (*visit)(Book*, void*), void* ctx);
+void displayPrefixMatches(int field, const char* prefix);
+size_t searchKeywords(const char* query, int** ids);
+void displayKeywordMatches(const char* query);
+int selectScanKernel(const char* name);
+size_t searchSubstring(const char* needle, int (*visit)(Book*, void*), void* ctx);
+void displaySubstringMatches(const char* needle);
+LibraryStats libraryStats(void);
+void displayStats(Section* sec);
 int issueBook(Section* sec, int id);
+int issueBookTo(Section* sec, int id, const char* borrower, time_t dueAt);
+size_t overdueLoans(time_t now, int (*visit)(const Loan*, void*), void* ctx);
+void displayOverdue(time_t now);
 int returnBook(Section* sec, int id);
+int returnBookFrom(Section* sec, int id, const char* borrower);
+int reserveBook(int id, const char* patron);
+int holdPosition(int id, const char* patron);
+int cancelHold(int id, const char* patron);
 int deleteBook(Section* sec, int id);
 Section* deleteSection(Section* head, char name[]);
+int issueBookById(int id);
+int returnBookById(int id);
+int deleteBookById(int id);
+int moveBookBetween(Section* source, Section* dest, int bookID);
+size_t moveBooks(Section* source, Section* dest, const int* ids, size_t n);
+size_t moveBooksWhere(Section* source, Section* dest, int (*match)(Book*, void*), void* ctx);
+size_t moveBooksInRange(Section* source, Section* dest, int lo, int hi);
+int saveSnapshot(Section* head, const char* path);
+Section* loadSnapshot(Section* head, const char* path);
+Section* replayWal(Section* head, const char* path);
+Section* importCsv(Section* head, const char* path, int threads, ImportReport* report);
+void displayImportReport(const ImportReport* r);
+long exportBooks(Section* sec, const char* format, const char* path);
+int walOpen(const char* path);
+void freeLibrary(Section* library);
+
+// --- Slab Allocator ---
+
+#define SLAB_POOL_MAX 64
+
+static Slab* slabPool;      // recycled empty slabs
+static size_t slabPoolSize;
+static Arena sectionArena = { 0 };
+
+static Slab* slabOf(void* p)
+{
+    return (Slab*)((uintptr_t)p & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static size_t slabHeaderSize(void)
+{
+    return (sizeof(Slab) + 15) & ~(size_t)15;
+}
+
+static void arenaInit(Arena* a, size_t objSize)
+{
+    memset(a, 0, sizeof(*a));
+    a->objSize = (objSize + 15) & ~(size_t)15;
+}
+
+static Slab* slabGet(void)
+{
+    pthread_mutex_lock(&slabLock);
+    Slab* slab = slabPool;
+    if(slab) {
+        slabPool = slab->next;
+        slabPoolSize--;
+    }
+    pthread_mutex_unlock(&slabLock);
+    if(!slab) {
+        slab = (Slab*)aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+        if(!slab) {
+            printf("Out of memory while allocating slab!\n");
+            exit(1);
+        }
+    }
+    return slab;
+}
+
+static void slabPut(Slab* slab)
+{
+    pthread_mutex_lock(&slabLock);
+    if(slabPoolSize < SLAB_POOL_MAX) {
+        slab->next = slabPool;
+        slabPool = slab;
+        slabPoolSize++;
+        slab = NULL;
+    }
+    pthread_mutex_unlock(&slabLock);
+    free(slab);
+}
+
+static void* arenaAlloc(Arena* a)
+{
+    void* p = a->freeList;
+    if(!p)
+        p = __atomic_exchange_n(&a->remoteFree, NULL, __ATOMIC_ACQUIRE);
+    if(p) {
+        a->freeList = *(void**)p;
+    } else {
+        if(!a->bump || a->bump + a->objSize > a->end) {
+            Slab* slab = slabGet();
+            slab->arena = a;
+            slab->live = 0;
+            slab->lent = 0;
+            slab->next = a->slabs;
+            a->slabs = slab;
+            a->bump = (char*)slab + slabHeaderSize();
+            a->end = (char*)slab + SLAB_SIZE;
+        }
+        p = a->bump;
+        a->bump += a->objSize;
+    }
+    __atomic_add_fetch(&slabOf(p)->live, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+static void arenaFree(Arena* a, void* p)
+{
+    __atomic_sub_fetch(&slabOf(p)->live, 1, __ATOMIC_RELAXED);
+    *(void**)p = a->freeList;
+    a->freeList = p;
+}
+
+// Release every slab of an arena at once. Slabs still holding books that
+// were moved to other sections are orphaned and freed when those go.
+static void arenaRelease(Arena* a)
+{
+    Slab* slab = a->slabs;
+    while(slab) {
+        Slab* next = slab->next;
+        if(slab->lent == 0) {
+            slabPut(slab);
+        } else {
+            slab->arena = NULL;
+            slab->live = slab->lent;
+            slab->next = NULL;
+        }
+        slab = next;
+    }
+    a->slabs = NULL;
+    a->bump = a->end = NULL;
+    a->freeList = NULL;
+    a->remoteFree = NULL;
+}
+
+// Free every slab of an arena, books lent to other sections included.
+// Only for tearing the whole catalog down.
+static void arenaDiscard(Arena* a)
+{
+    Slab* slab = a->slabs;
+    while(slab) {
+        Slab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    a->slabs = NULL;
+    a->bump = a->end = NULL;
+    a->freeList = NULL;
+    a->remoteFree = NULL;
+}
+
+static Book* bookAlloc(Section* sec)
+{
+    return (Book*)arenaAlloc(&sec->arena);
+}
+
+// Free a single book owned by `owner`, wherever its slab lives
+static void bookFree(Section* owner, Book* book)
+{
+    Slab* slab = slabOf(book);
+    if(!slab->arena) {
+        if(__atomic_sub_fetch(&slab->live, 1, __ATOMIC_ACQ_REL) == 0)
+            slabPut(slab);
+        return;
+    }
+    if(slab->arena == &owner->arena) {
+        arenaFree(&owner->arena, book);
+        return;
+    }
+    // The slab's section may be allocating from its free list right now,
+    // so the node goes back through that arena's remote list instead
+    Arena* a = slab->arena;
+    __atomic_sub_fetch(&slab->lent, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&slab->live, 1, __ATOMIC_RELAXED);
+    void* head = __atomic_load_n(&a->remoteFree, __ATOMIC_RELAXED);
+    do {
+        *(void**)book = head;
+    } while(!__atomic_compare_exchange_n(&a->remoteFree, &head, (void*)book, 1,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Keep lent counts right when a book changes owner without moving memory
+static void bookMoved(Book* book, Section* from, Section* to)
+{
+    Slab* slab = slabOf(book);
+    if(!slab->arena)
+        return;
+    if(slab->arena == &from->arena)
+        __atomic_add_fetch(&slab->lent, 1, __ATOMIC_RELAXED);
+    if(slab->arena == &to->arena)
+        __atomic_sub_fetch(&slab->lent, 1, __ATOMIC_RELAXED);
+}
+
+static void freeSlabPool(void)
+{
+    arenaRelease(&sectionArena);
+    while(slabPool) {
+        Slab* next = slabPool->next;
+        free(slabPool);
+        slabPool = next;
+    }
+    slabPoolSize = 0;
+}
+
+// --- Hot Columns ---
+// Each section keeps its titles' IDs and status bits in contiguous
+// arrays, so status checks and scans stay out of the 100+ byte Book
+// nodes. Most titles have a single copy, and for those the availability
+// bit is the whole story; titles with several copies also set their
+// multi-copy bit and keep counts in the stock column. Removal swaps the
+// last column into the hole.
+// Bits and on-shelf counts are read and written atomically so index
+// lookups can check them without the section lock. Their writers are
+// serialized by the ID's loan stripe or by indexLock held for writing, so a
+// column's bits always end up matching its counts. The arrays are only
+// reallocated, and copy counts only change, with indexLock held for
+// writing.
+
+static BookSlot* indexSlotOf(Book* book);
+
+static int columnAvailable(const Section* sec, int col)
+{
+    return (int)((__atomic_load_n(&sec->bits[col >> 6].available, __ATOMIC_RELAXED) >> (col & 63)) & 1);
+}
+
+static void columnSetAvailable(Section* sec, int col, int available)
+{
+    uint64_t bit = 1ULL << (col & 63);
+    if(available)
+        __atomic_fetch_or(&sec->bits[col >> 6].available, bit, __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_and(&sec->bits[col >> 6].available, ~bit, __ATOMIC_RELAXED);
+}
+
+static int columnMultiCopy(const Section* sec, int col)
+{
+    return (int)((__atomic_load_n(&sec->bits[col >> 6].multiCopy, __ATOMIC_RELAXED) >> (col & 63)) & 1);
+}
+
+static int columnCopies(const Section* sec, int col)
+{
+    return columnMultiCopy(sec, col) ? sec->stock[col].copies : 1;
+}
+
+static int columnOnShelf(const Section* sec, int col)
+{
+    if(columnMultiCopy(sec, col))
+        return __atomic_load_n(&sec->stock[col].onShelf, __ATOMIC_RELAXED);
+    return columnAvailable(sec, col);
+}
+
+static void columnSetStock(Section* sec, int col, int copies, int onShelf)
+{
+    uint64_t bit = 1ULL << (col & 63);
+    if(copies > 1) {
+        sec->stock[col].copies = copies;
+        __atomic_store_n(&sec->stock[col].onShelf, onShelf, __ATOMIC_RELAXED);
+        __atomic_fetch_or(&sec->bits[col >> 6].multiCopy, bit, __ATOMIC_RELAXED);
+    } else if(columnMultiCopy(sec, col)) {
+        __atomic_fetch_and(&sec->bits[col >> 6].multiCopy, ~bit, __ATOMIC_RELAXED);
+    }
+    columnSetAvailable(sec, col, onShelf > 0);
+}
+
+// Take one copy of the title off the shelf (issue) or put one back.
+// A single-copy title flips its availability bit with a compare-and-swap
+// that fails if the bit is already the other way; a multi-copy title does
+// the same on its on-shelf count and then fixes the bit. The ID's loan
+// stripe keeps one title's count and bit in step; the compare-and-swap
+// lets titles sharing the word change at the same time.
+static int columnClaim(Section* sec, int col, int issue)
+{
+    uint64_t* word = &sec->bits[col >> 6].available;
+    uint64_t bit = 1ULL << (col & 63);
+    if(!columnMultiCopy(sec, col)) {
+        uint64_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+        do {
+            if(((old & bit) != 0) != (issue != 0))
+                return 0;
+            // retried only when a neighbouring bit in the word changed
+        } while(!__atomic_compare_exchange_n(word, &old, old ^ bit, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        return 1;
+    }
+    int* onShelf = &sec->stock[col].onShelf;
+    int old = __atomic_load_n(onShelf, __ATOMIC_RELAXED), left;
+    do {
+        left = issue ? old - 1 : old + 1;
+        if(left < 0 || left > sec->stock[col].copies)
+            return 0;
+    } while(!__atomic_compare_exchange_n(onShelf, &old, left, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    if(issue && left == 0)
+        __atomic_fetch_and(word, ~bit, __ATOMIC_RELAXED);
+    else if(!issue && old == 0)
+        __atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Does the title have a copy whose issued state is `issued` (-1 = any)?
+static int columnHas(const Section* sec, int col, int issued)
+{
+    if(issued < 0)
+        return 1;
+    if(!columnMultiCopy(sec, col))
+        return columnAvailable(sec, col) != issued;
+    int onShelf = __atomic_load_n(&sec->stock[col].onShelf, __ATOMIC_RELAXED);
+    return issued ? onShelf < sec->stock[col].copies : onShelf > 0;
+}
+
+static void columnsReserve(Section* sec, int n)
+{
+    if(sec->count + n <= sec->capacity)
+        return;
+    int newCap = sec->capacity ? sec->capacity : 64;
+    while(newCap < sec->count + n)
+        newCap *= 2;
+    int* ids = (int*)realloc(sec->ids, sizeof(int) * (size_t)newCap);
+    ColumnBits* bits = (ColumnBits*)realloc(sec->bits, sizeof(ColumnBits) * (size_t)(newCap / 64));
+    Stock* stock = (Stock*)realloc(sec->stock, sizeof(Stock) * (size_t)newCap);
+    Book** nodes = (Book**)realloc(sec->nodes, sizeof(Book*) * (size_t)newCap);
+    if(!ids || !bits || !stock || !nodes) {
+        printf("Out of memory while growing section columns!\n");
+        exit(1);
+    }
+    memset(bits + sec->capacity / 64, 0, sizeof(ColumnBits) * (size_t)((newCap - sec->capacity) / 64));
+    sec->ids = ids;
+    sec->bits = bits;
+    sec->stock = stock;
+    sec->nodes = nodes;
+    sec->capacity = newCap;
+}
+
+// New column for a title with `copies` copies, `onShelf` of them not
+// issued. The section's copy and issued totals are the caller's job.
+static int columnsAppend(Section* sec, Book* book, int copies, int onShelf)
+{
+    columnsReserve(sec, 1);
+    int col = sec->count++;
+    sec->ids[col] = book->id;
+    sec->nodes[col] = book;
+    columnSetStock(sec, col, copies, onShelf);
+    book->col = col;
+    return col;
+}
+
+static void columnsRemove(Section* sec, int col)
+{
+    int last = --sec->count;
+    if(col != last) {
+        Book* moved = sec->nodes[last];
+        sec->ids[col] = sec->ids[last];
+        sec->nodes[col] = moved;
+        columnSetStock(sec, col, columnCopies(sec, last), columnOnShelf(sec, last));
+        moved->col = col;
+        indexSlotOf(moved)->col = col;
+    }
+    columnSetStock(sec, last, 1, 0);
+}
+
+static void columnsFree(Section* sec)
+{
+    free(sec->ids);
+    free(sec->bits);
+    free(sec->stock);
+    free(sec->nodes);
+    sec->ids = NULL;
+    sec->bits = NULL;
+    sec->stock = NULL;
+    sec->nodes = NULL;
+    sec->count = sec->capacity = 0;
+}
+
+int countAvailable(Section* sec)
+{
+    return sec->copyCount - __atomic_load_n(&sec->issued, __ATOMIC_RELAXED);
+}
+
+// --- Book ID Index ---
+// Open addressing with linear probing. Deletion shifts later entries back
+// instead of leaving tombstones, so probe chains never grow stale.
+
+#define INDEX_MIN_CAPACITY 1024
+
+static size_t hashId(int id)
+{
+    unsigned int x = (unsigned int)id;
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static void indexPut(BookSlot* slots, size_t capacity, BookSlot entry)
+{
+    size_t mask = capacity - 1;
+    size_t i = hashId(entry.id) & mask;
+    while(slots[i].book)
+        i = (i + 1) & mask;
+    slots[i] = entry;
+}
+
+static void indexGrow(void)
+{
+    size_t newCap = bookIndex.capacity ? bookIndex.capacity * 2 : INDEX_MIN_CAPACITY;
+    BookSlot* newSlots = (BookSlot*)calloc(newCap, sizeof(BookSlot));
+    if(!newSlots) {
+        printf("Out of memory while growing book index!\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < bookIndex.capacity; i++) {
+        if(bookIndex.slots[i].book)
+            indexPut(newSlots, newCap, bookIndex.slots[i]);
+    }
+    free(bookIndex.slots);
+    bookIndex.slots = newSlots;
+    bookIndex.capacity = newCap;
+}
+
+// Size the table up front for n more books so bulk loads never rehash
+static void indexReserve(size_t n)
+{
+    while((bookIndex.count + n) * 10 > bookIndex.capacity * 7)
+        indexGrow();
+}
+
+static void indexInsert(Book* book, Section* sec)
+{
+    // keep load factor under 0.7
+    if((bookIndex.count + 1) * 10 > bookIndex.capacity * 7)
+        indexGrow();
+    BookSlot entry = { book->id, book->col, book, sec, 0 };
+    indexPut(bookIndex.slots, bookIndex.capacity, entry);
+    bookIndex.count++;
+}
+
+// Find an entry for `id`. sec == NULL matches any section;
+// issued == -1 matches any title, otherwise only titles with a copy in
+// that state.
+static BookSlot* indexFind(Section* sec, int id, int issued)
+{
+    if(!bookIndex.count)
+        return NULL;
+    size_t mask = bookIndex.capacity - 1;
+    size_t i = hashId(id) & mask;
+    while(bookIndex.slots[i].book) {
+        BookSlot* s = &bookIndex.slots[i];
+        if(s->id == id && (!sec || s->section == sec) && columnHas(s->section, s->col, issued))
+            return s;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static BookSlot* indexSlotOf(Book* book)
+{
+    size_t mask = bookIndex.capacity - 1;
+    size_t i = hashId(book->id) & mask;
+    while(bookIndex.slots[i].book != book)
+        i = (i + 1) & mask;
+    return &bookIndex.slots[i];
+}
+
+static void indexRemove(Book* book)
+{
+    size_t mask = bookIndex.capacity - 1;
+    size_t hole = (size_t)(indexSlotOf(book) - bookIndex.slots);
+    size_t i = hole;
+
+    // Backward-shift: pull forward any entry whose probe path crosses the hole
+    for(;;) {
+        i = (i + 1) & mask;
+        if(!bookIndex.slots[i].book)
+            break;
+        size_t home = hashId(bookIndex.slots[i].id) & mask;
+        if(((i - home) & mask) >= ((i - hole) & mask)) {
+            bookIndex.slots[hole] = bookIndex.slots[i];
+            hole = i;
+        }
+    }
+    bookIndex.slots[hole].book = NULL;
+    bookIndex.count--;
+}
+
+static void freeBookIndex(void)
+{
+    free(bookIndex.slots);
+    bookIndex.slots = NULL;
+    bookIndex.capacity = 0;
+    bookIndex.count = 0;
+}
+
+// --- Catalog ID Tree ---
+// B+tree over every title in the library, so a range of IDs across all
+// sections is one descent plus a walk along the leaves, O(log n + k).
+// The key is the ID with the record's address as a tiebreak, which keeps
+// entries unique when copies of one ID sit in several sections. Leaves
+// carry the record and its section and are chained in key order. Nodes
+// come from their own arenas; guarded by indexLock like the book index.
+
+#define BTREE_ORDER 64              // entries per leaf, children per inner node
+#define BTREE_MIN (BTREE_ORDER / 2)
+#define BTREE_MAX_HEIGHT 16
+
+typedef struct BTreeLeaf
+{
+    int count;
+    int ids[BTREE_ORDER];
+    Book* books[BTREE_ORDER];
+    Section* sections[BTREE_ORDER];
+    struct BTreeLeaf* next;
+} BTreeLeaf;
+
+// Keys under children[i] sort before separator i, keys under
+// children[i + 1] from it on
+typedef struct BTreeInner
+{
+    int count;                      // children
+    int ids[BTREE_ORDER - 1];
+    Book* books[BTREE_ORDER - 1];
+    void* children[BTREE_ORDER];
+} BTreeInner;
+
+typedef struct IdTree
+{
+    void* root;                     // a leaf while height is 1, NULL = empty
+    int height;
+    BTreeLeaf* first;
+    size_t count;
+} IdTree;
+
+static IdTree idTree;
+static Arena leafArena = { 0 };
+static Arena innerArena = { 0 };
+
+static int idKeyLess(int id, const Book* book, int otherId, const Book* other)
+{
+    return id < otherId || (id == otherId && (uintptr_t)book < (uintptr_t)other);
+}
+
+// Child of `n` whose subtree holds the key
+static int innerChild(const BTreeInner* n, int id, const Book* book)
+{
+    int lo = 0, hi = n->count - 1;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(idKeyLess(id, book, n->ids[mid], n->books[mid]))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// First entry of `leaf` not before the key
+static int leafLowerBound(const BTreeLeaf* leaf, int id, const Book* book)
+{
+    int lo = 0, hi = leaf->count;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(idKeyLess(leaf->ids[mid], leaf->books[mid], id, book))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Descend to the leaf for the key, noting the inner nodes passed and
+// which child was taken in each
+static BTreeLeaf* idTreeDescend(int id, const Book* book, BTreeInner* path[], int at[])
+{
+    void* node = idTree.root;
+    for(int d = 0; d < idTree.height - 1; d++) {
+        BTreeInner* inner = (BTreeInner*)node;
+        int c = innerChild(inner, id, book);
+        if(path) {
+            path[d] = inner;
+            at[d] = c;
+        }
+        node = inner->children[c];
+    }
+    return (BTreeLeaf*)node;
+}
+
+static void* idTreeNode(Arena* a)
+{
+    if(!a->objSize) {
+        arenaInit(&leafArena, sizeof(BTreeLeaf));
+        arenaInit(&innerArena, sizeof(BTreeInner));
+    }
+    void* n = arenaAlloc(a);
+    memset(n, 0, a->objSize);
+    return n;
+}
+
+// Add separator `id`/`book` with `right` as the child after it to the
+// inner node at depth d of the path, splitting upwards as needed
+static void innerInsert(BTreeInner* path[], int at[], int d, int id, Book* book, void* right)
+{
+    while(d >= 0) {
+        BTreeInner* n = path[d];
+        int c = at[d];
+        if(n->count < BTREE_ORDER) {
+            memmove(&n->ids[c + 1], &n->ids[c], sizeof(int) * (size_t)(n->count - 1 - c));
+            memmove(&n->books[c + 1], &n->books[c], sizeof(Book*) * (size_t)(n->count - 1 - c));
+            memmove(&n->children[c + 2], &n->children[c + 1], sizeof(void*) * (size_t)(n->count - 1 - c));
+            n->ids[c] = id;
+            n->books[c] = book;
+            n->children[c + 1] = right;
+            n->count++;
+            return;
+        }
+
+        // Full: lay out all ORDER + 1 children, keep the lower half
+        int ids[BTREE_ORDER];
+        Book* books[BTREE_ORDER];
+        void* children[BTREE_ORDER + 1];
+        for(int i = 0, j = 0; i < BTREE_ORDER; i++) {
+            if(i == c) {
+                ids[i] = id;
+                books[i] = book;
+            } else {
+                ids[i] = n->ids[j];
+                books[i] = n->books[j++];
+            }
+        }
+        for(int i = 0, j = 0; i <= BTREE_ORDER; i++)
+            children[i] = i == c + 1 ? right : n->children[j++];
+
+        int keep = (BTREE_ORDER + 1) / 2;
+        BTreeInner* sibling = (BTreeInner*)idTreeNode(&innerArena);
+        n->count = keep;
+        memcpy(n->ids, ids, sizeof(int) * (size_t)(keep - 1));
+        memcpy(n->books, books, sizeof(Book*) * (size_t)(keep - 1));
+        memcpy(n->children, children, sizeof(void*) * (size_t)keep);
+        sibling->count = BTREE_ORDER + 1 - keep;
+        memcpy(sibling->ids, &ids[keep], sizeof(int) * (size_t)(sibling->count - 1));
+        memcpy(sibling->books, &books[keep], sizeof(Book*) * (size_t)(sibling->count - 1));
+        memcpy(sibling->children, &children[keep], sizeof(void*) * (size_t)sibling->count);
+        id = ids[keep - 1];
+        book = books[keep - 1];
+        right = sibling;
+        d--;
+    }
+
+    // The root split: grow a level
+    BTreeInner* root = (BTreeInner*)idTreeNode(&innerArena);
+    root->count = 2;
+    root->ids[0] = id;
+    root->books[0] = book;
+    root->children[0] = idTree.root;
+    root->children[1] = right;
+    idTree.root = root;
+    idTree.height++;
+}
+
+// Caller holds indexLock for writing
+static void idTreeInsert(Book* book, Section* sec)
+{
+    if(!idTree.root) {
+        idTree.root = idTree.first = (BTreeLeaf*)idTreeNode(&leafArena);
+        idTree.height = 1;
+    }
+    BTreeInner* path[BTREE_MAX_HEIGHT];
+    int at[BTREE_MAX_HEIGHT];
+    BTreeLeaf* leaf = idTreeDescend(book->id, book, path, at);
+    int pos = leafLowerBound(leaf, book->id, book);
+    idTree.count++;
+    if(leaf->count < BTREE_ORDER) {
+        memmove(&leaf->ids[pos + 1], &leaf->ids[pos], sizeof(int) * (size_t)(leaf->count - pos));
+        memmove(&leaf->books[pos + 1], &leaf->books[pos], sizeof(Book*) * (size_t)(leaf->count - pos));
+        memmove(&leaf->sections[pos + 1], &leaf->sections[pos], sizeof(Section*) * (size_t)(leaf->count - pos));
+        leaf->ids[pos] = book->id;
+        leaf->books[pos] = book;
+        leaf->sections[pos] = sec;
+        leaf->count++;
+        return;
+    }
+
+    int ids[BTREE_ORDER + 1];
+    Book* books[BTREE_ORDER + 1];
+    Section* sections[BTREE_ORDER + 1];
+    for(int i = 0, j = 0; i <= BTREE_ORDER; i++) {
+        if(i == pos) {
+            ids[i] = book->id;
+            books[i] = book;
+            sections[i] = sec;
+        } else {
+            ids[i] = leaf->ids[j];
+            books[i] = leaf->books[j];
+            sections[i] = leaf->sections[j++];
+        }
+    }
+    // Appending past the last leaf (IDs loaded in order) leaves it full
+    // rather than half empty
+    int keep = pos == BTREE_ORDER && !leaf->next ? BTREE_ORDER : (BTREE_ORDER + 1) / 2;
+    BTreeLeaf* sibling = (BTreeLeaf*)idTreeNode(&leafArena);
+    leaf->count = keep;
+    memcpy(leaf->ids, ids, sizeof(int) * (size_t)keep);
+    memcpy(leaf->books, books, sizeof(Book*) * (size_t)keep);
+    memcpy(leaf->sections, sections, sizeof(Section*) * (size_t)keep);
+    sibling->count = BTREE_ORDER + 1 - keep;
+    memcpy(sibling->ids, &ids[keep], sizeof(int) * (size_t)sibling->count);
+    memcpy(sibling->books, &books[keep], sizeof(Book*) * (size_t)sibling->count);
+    memcpy(sibling->sections, &sections[keep], sizeof(Section*) * (size_t)sibling->count);
+    sibling->next = leaf->next;
+    leaf->next = sibling;
+    innerInsert(path, at, idTree.height - 2, ids[keep], books[keep], sibling);
+}
+
+// Drop separator k and the child after it from an inner node
+static void innerRemoveAt(BTreeInner* n, int k)
+{
+    memmove(&n->ids[k], &n->ids[k + 1], sizeof(int) * (size_t)(n->count - 2 - k));
+    memmove(&n->books[k], &n->books[k + 1], sizeof(Book*) * (size_t)(n->count - 2 - k));
+    memmove(&n->children[k + 1], &n->children[k + 2], sizeof(void*) * (size_t)(n->count - 2 - k));
+    n->count--;
+}
+
+// Refill an inner node at depth d that fell under BTREE_MIN children, by
+// borrowing from a sibling or merging with one, up to the root
+static void innerRebalance(BTreeInner* path[], int at[], int d)
+{
+    for(; d > 0; d--) {
+        BTreeInner* n = path[d];
+        if(n->count >= BTREE_MIN)
+            return;
+        BTreeInner* parent = path[d - 1];
+        int c = at[d - 1];
+        BTreeInner* left = c > 0 ? (BTreeInner*)parent->children[c - 1] : NULL;
+        BTreeInner* right = c < parent->count - 1 ? (BTreeInner*)parent->children[c + 1] : NULL;
+        if(left && left->count > BTREE_MIN) {
+            memmove(&n->ids[1], n->ids, sizeof(int) * (size_t)(n->count - 1));
+            memmove(&n->books[1], n->books, sizeof(Book*) * (size_t)(n->count - 1));
+            memmove(&n->children[1], n->children, sizeof(void*) * (size_t)n->count);
+            n->ids[0] = parent->ids[c - 1];
+            n->books[0] = parent->books[c - 1];
+            n->children[0] = left->children[left->count - 1];
+            parent->ids[c - 1] = left->ids[left->count - 2];
+            parent->books[c - 1] = left->books[left->count - 2];
+            left->count--;
+            n->count++;
+            return;
+        }
+        if(right && right->count > BTREE_MIN) {
+            n->ids[n->count - 1] = parent->ids[c];
+            n->books[n->count - 1] = parent->books[c];
+            n->children[n->count] = right->children[0];
+            parent->ids[c] = right->ids[0];
+            parent->books[c] = right->books[0];
+            memmove(right->ids, &right->ids[1], sizeof(int) * (size_t)(right->count - 2));
+            memmove(right->books, &right->books[1], sizeof(Book*) * (size_t)(right->count - 2));
+            memmove(right->children, &right->children[1], sizeof(void*) * (size_t)(right->count - 1));
+            right->count--;
+            n->count++;
+            return;
+        }
+        // Merge the pair into its left node; the separator comes down
+        int k = left ? c - 1 : c;
+        BTreeInner* into = left ? left : n;
+        BTreeInner* from = left ? n : right;
+        into->ids[into->count - 1] = parent->ids[k];
+        into->books[into->count - 1] = parent->books[k];
+        memcpy(&into->ids[into->count], from->ids, sizeof(int) * (size_t)(from->count - 1));
+        memcpy(&into->books[into->count], from->books, sizeof(Book*) * (size_t)(from->count - 1));
+        memcpy(&into->children[into->count], from->children, sizeof(void*) * (size_t)from->count);
+        into->count += from->count;
+        arenaFree(&innerArena, from);
+        innerRemoveAt(parent, k);
+    }
+
+    // Root with a single child: drop a level
+    BTreeInner* root = (BTreeInner*)idTree.root;
+    if(idTree.height > 1 && root->count == 1) {
+        idTree.root = root->children[0];
+        idTree.height--;
+        arenaFree(&innerArena, root);
+    }
+}
+
+// Caller holds indexLock for writing
+static void idTreeRemove(Book* book)
+{
+    BTreeInner* path[BTREE_MAX_HEIGHT];
+    int at[BTREE_MAX_HEIGHT];
+    BTreeLeaf* leaf = idTreeDescend(book->id, book, path, at);
+    int pos = leafLowerBound(leaf, book->id, book);
+    if(pos == leaf->count || leaf->books[pos] != book)
+        return;
+    memmove(&leaf->ids[pos], &leaf->ids[pos + 1], sizeof(int) * (size_t)(leaf->count - 1 - pos));
+    memmove(&leaf->books[pos], &leaf->books[pos + 1], sizeof(Book*) * (size_t)(leaf->count - 1 - pos));
+    memmove(&leaf->sections[pos], &leaf->sections[pos + 1], sizeof(Section*) * (size_t)(leaf->count - 1 - pos));
+    leaf->count--;
+    idTree.count--;
+
+    if(idTree.height == 1) {
+        if(!leaf->count) {
+            arenaFree(&leafArena, leaf);
+            idTree.root = idTree.first = NULL;
+            idTree.height = 0;
+        }
+        return;
+    }
+    if(leaf->count >= BTREE_MIN)
+        return;
+    int d = idTree.height - 2;
+    BTreeInner* parent = path[d];
+    int c = at[d];
+    BTreeLeaf* left = c > 0 ? (BTreeLeaf*)parent->children[c - 1] : NULL;
+    BTreeLeaf* right = c < parent->count - 1 ? (BTreeLeaf*)parent->children[c + 1] : NULL;
+    if(left && left->count > BTREE_MIN) {
+        int last = left->count - 1;
+        memmove(&leaf->ids[1], leaf->ids, sizeof(int) * (size_t)leaf->count);
+        memmove(&leaf->books[1], leaf->books, sizeof(Book*) * (size_t)leaf->count);
+        memmove(&leaf->sections[1], leaf->sections, sizeof(Section*) * (size_t)leaf->count);
+        leaf->ids[0] = left->ids[last];
+        leaf->books[0] = left->books[last];
+        leaf->sections[0] = left->sections[last];
+        leaf->count++;
+        left->count--;
+        parent->ids[c - 1] = leaf->ids[0];
+        parent->books[c - 1] = leaf->books[0];
+        return;
+    }
+    if(right && right->count > BTREE_MIN) {
+        leaf->ids[leaf->count] = right->ids[0];
+        leaf->books[leaf->count] = right->books[0];
+        leaf->sections[leaf->count] = right->sections[0];
+        leaf->count++;
+        right->count--;
+        memmove(right->ids, &right->ids[1], sizeof(int) * (size_t)right->count);
+        memmove(right->books, &right->books[1], sizeof(Book*) * (size_t)right->count);
+        memmove(right->sections, &right->sections[1], sizeof(Section*) * (size_t)right->count);
+        parent->ids[c] = right->ids[0];
+        parent->books[c] = right->books[0];
+        return;
+    }
+    int k = left ? c - 1 : c;
+    BTreeLeaf* into = left ? left : leaf;
+    BTreeLeaf* from = left ? leaf : right;
+    memcpy(&into->ids[into->count], from->ids, sizeof(int) * (size_t)from->count);
+    memcpy(&into->books[into->count], from->books, sizeof(Book*) * (size_t)from->count);
+    memcpy(&into->sections[into->count], from->sections, sizeof(Section*) * (size_t)from->count);
+    into->count += from->count;
+    into->next = from->next;
+    arenaFree(&leafArena, from);
+    innerRemoveAt(parent, k);
+    innerRebalance(path, at, d);
+}
+
+// A whole record changed sections. Caller holds indexLock for writing
+static void idTreeMove(Book* book, Section* dest)
+{
+    BTreeLeaf* leaf = idTreeDescend(book->id, book, NULL, NULL);
+    int pos = leafLowerBound(leaf, book->id, book);
+    if(pos < leaf->count && leaf->books[pos] == book)
+        leaf->sections[pos] = dest;
+}
+
+static void freeIdTree(void)
+{
+    arenaRelease(&leafArena);
+    arenaRelease(&innerArena);
+    memset(&idTree, 0, sizeof(idTree));
+}
+
+// --- Section Directory ---
+// Same probing scheme as the book index. A lookup is a hash compare
+// followed by a single memcmp of the interned name.
+
+#define DIR_MIN_CAPACITY 64
+
+static unsigned int hashName(const char* name, size_t len)
+{
+    unsigned int h = 2166136261U; // FNV-1a
+    for(size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static void dirPut(SectionSlot* slots, size_t capacity, SectionSlot entry)
+{
+    size_t mask = capacity - 1;
+    size_t i = entry.hash & mask;
+    while(slots[i].section)
+        i = (i + 1) & mask;
+    slots[i] = entry;
+}
+
+static void dirGrow(void)
+{
+    size_t newCap = sectionDir.capacity ? sectionDir.capacity * 2 : DIR_MIN_CAPACITY;
+    SectionSlot* newSlots = (SectionSlot*)calloc(newCap, sizeof(SectionSlot));
+    if(!newSlots) {
+        printf("Out of memory while growing section directory!\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < sectionDir.capacity; i++) {
+        if(sectionDir.slots[i].section)
+            dirPut(newSlots, newCap, sectionDir.slots[i]);
+    }
+    free(sectionDir.slots);
+    sectionDir.slots = newSlots;
+    sectionDir.capacity = newCap;
+}
+
+static SectionSlot* dirFind(const char* name, size_t len, unsigned int hash)
+{
+    if(!sectionDir.count)
+        return NULL;
+    size_t mask = sectionDir.capacity - 1;
+    size_t i = hash & mask;
+    while(sectionDir.slots[i].section) {
+        SectionSlot* s = &sectionDir.slots[i];
+        if(s->hash == hash && s->section->nameLen == len &&
+           memcmp(s->section->name, name, len) == 0)
+            return s;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void dirInsert(Section* sec)
+{
+    SectionSlot* existing = dirFind(sec->name, sec->nameLen, sec->hash);
+    if(existing) {
+        // Newest section shadows older ones, as the list search used to
+        sec->older = existing->section;
+        existing->section = sec;
+        return;
+    }
+    if((sectionDir.count + 1) * 10 > sectionDir.capacity * 7)
+        dirGrow();
+    SectionSlot entry = { sec->hash, sec };
+    dirPut(sectionDir.slots, sectionDir.capacity, entry);
+    sectionDir.count++;
+}
+
+static void dirRemove(Section* sec)
+{
+    SectionSlot* slot = dirFind(sec->name, sec->nameLen, sec->hash);
+    if(!slot)
+        return;
+    if(slot->section != sec) {
+        // Shadowed duplicate: just drop it from the chain
+        Section* s = slot->section;
+        while(s->older && s->older != sec)
+            s = s->older;
+        if(s->older)
+            s->older = sec->older;
+        return;
+    }
+    if(sec->older) {
+        slot->section = sec->older;
+        return;
+    }
+
+    size_t mask = sectionDir.capacity - 1;
+    size_t hole = (size_t)(slot - sectionDir.slots);
+    size_t i = hole;
+    for(;;) {
+        i = (i + 1) & mask;
+        if(!sectionDir.slots[i].section)
+            break;
+        size_t home = sectionDir.slots[i].hash & mask;
+        if(((i - home) & mask) >= ((i - hole) & mask)) {
+            sectionDir.slots[hole] = sectionDir.slots[i];
+            hole = i;
+        }
+    }
+    sectionDir.slots[hole].section = NULL;
+    sectionDir.count--;
+}
+
+static void freeSectionDirectory(void)
+{
+    free(sectionDir.slots);
+    sectionDir.slots = NULL;
+    sectionDir.capacity = 0;
+    sectionDir.count = 0;
+}
+
+// --- Ordered Sections ---
+// A section can keep its book list sorted by ID. The list is then level 0
+// of a skip list: books get a tower of links on higher levels, so an
+// insert finds its place and a range query finds its first ID in
+// O(log n), and the range is read off the list from there. Tower heights
+// come from a hash of the ID (one in four books reaches each next level),
+// so no random state is shared between threads and a section rebuilds
+// the same shape after a reload. Towers are only allocated for books
+// that rise above level 0.
+
+#define SKIP_MAX_LEVEL 16
+
+static int skipHeight(int id)
+{
+    uint32_t h = (uint32_t)hashId(id ^ 0x5bd1e995);
+    return 1 + __builtin_ctz(h | (1U << 30)) / 2;
+}
+
+// Forward link of `b` (NULL = the head) on `level`
+static Book** skipLink(Section* sec, Book* b, int level)
+{
+    if(level == 0)
+        return b ? &b->next : &sec->books;
+    return b ? &b->tower->next[level - 1] : &sec->skip->next[level - 1];
+}
+
+// Last book before `id` on every level in use, NULL = the head
+static void skipPath(Section* sec, int id, Book* path[SKIP_MAX_LEVEL])
+{
+    Book* b = NULL;
+    for(int level = sec->skip->height - 1; level >= 0; level--) {
+        Book* next;
+        while((next = *skipLink(sec, b, level)) && next->id < id)
+            b = next;
+        path[level] = b;
+    }
+}
+
+static SkipTower* skipTowerAlloc(int height)
+{
+    SkipTower* t = (SkipTower*)calloc(1, sizeof(SkipTower) + sizeof(Book*) * (size_t)(height - 1));
+    if(!t) {
+        printf("Out of memory while ordering a section!\n");
+        exit(1);
+    }
+    t->height = height;
+    return t;
+}
+
+// First book with an ID of at least `id`, or NULL
+static Book* skipSeek(Section* sec, int id)
+{
+    Book* path[SKIP_MAX_LEVEL];
+    skipPath(sec, id, path);
+    return *skipLink(sec, path[0], 0);
+}
+
+// Caller holds the section for writing
+static void skipInsert(Section* sec, Book* book)
+{
+    Book* path[SKIP_MAX_LEVEL];
+    int height = skipHeight(book->id);
+    skipPath(sec, book->id, path);
+    for(int level = sec->skip->height; level < height; level++)
+        path[level] = NULL;
+    if(height > sec->skip->height)
+        sec->skip->height = height;
+
+    book->prev = path[0];
+    book->next = *skipLink(sec, path[0], 0);
+    if(book->next)
+        book->next->prev = book;
+    *skipLink(sec, path[0], 0) = book;
+    book->tower = height > 1 ? skipTowerAlloc(height) : NULL;
+    for(int level = 1; level < height; level++) {
+        Book** link = skipLink(sec, path[level], level);
+        book->tower->next[level - 1] = *link;
+        *link = book;
+    }
+}
+
+// Take a book off the levels above the list; unlinkBook does the list
+static void skipRemove(Section* sec, Book* book)
+{
+    if(!book->tower)
+        return;
+    Book* path[SKIP_MAX_LEVEL];
+    skipPath(sec, book->id, path);
+    for(int level = 1; level < book->tower->height; level++)
+        *skipLink(sec, path[level], level) = book->tower->next[level - 1];
+    free(book->tower);
+    book->tower = NULL;
+}
+
+// Give every book of an ID-sorted list its tower in one pass
+static void skipBuild(Section* sec)
+{
+    Book* last[SKIP_MAX_LEVEL] = { NULL };
+    sec->skip = skipTowerAlloc(SKIP_MAX_LEVEL);
+    sec->skip->height = 1;
+    for(Book* b = sec->books; b; b = b->next) {
+        int height = skipHeight(b->id);
+        if(height == 1)
+            continue;
+        b->tower = skipTowerAlloc(height);
+        if(height > sec->skip->height)
+            sec->skip->height = height;
+        for(int level = 1; level < height; level++) {
+            *skipLink(sec, last[level], level) = b;
+            last[level] = b;
+        }
+    }
+}
+
+static void skipFree(Section* sec)
+{
+    free(sec->skip);
+    sec->skip = NULL;
+}
+
+// Put a new or moved-in record on the section's list: at the front, or
+// in ID order for an ordered section
+static void linkBook(Section* sec, Book* book)
+{
+    if(sec->skip) {
+        skipInsert(sec, book);
+        return;
+    }
+    book->tower = NULL;
+    book->prev = NULL;
+    book->next = sec->books;
+    if(sec->books)
+        sec->books->prev = book;
+    sec->books = book;
+}
+
+// Detach a book from its section list in O(1), or O(log n) when it has
+// a tower in an ordered section
+static void unlinkBook(Section* sec, Book* book)
+{
+    if(sec->skip)
+        skipRemove(sec, book);
+    if(book->prev)
+        book->prev->next = book->next;
+    else
+        sec->books = book->next;
+    if(book->next)
+        book->next->prev = book->prev;
+    book->prev = book->next = NULL;
+}
+
+// --- Prefix Search Index ---
+// One crit-bit tree per field (title, author). Leaves are the Book nodes
+// themselves, so the tree costs one small internal node per book. Keys
+// compare case-insensitively; the node address is appended after the
+// text so books with equal titles still get distinct keys. A prefix
+// lookup walks O(prefix length) nodes to the subtree holding every match,
+// and that subtree has fewer internal nodes than matches.
+
+enum { FIELD_TITLE = 0, FIELD_AUTHOR = 1 };
+
+typedef struct CritNode
+{
+    void* child[2];     // tagged: low bit set = internal CritNode
+    uint32_t byte;
+    uint8_t otherbits;  // every bit set except the critical one
+} CritNode;
+
+static void* prefixRoot[2];
+static Arena critArena = { 0 };
+
+static int isInternal(void* p)
+{
+    return (int)((uintptr_t)p & 1);
+}
+
+static CritNode* critNode(void* p)
+{
+    return (CritNode*)((uintptr_t)p - 1);
+}
+
+// A book's key in one field, with the text length worked out once
+// rather than on every byte looked at
+typedef struct CritKey
+{
+    const Book* book;
+    const char* text;
+    size_t len;
+} CritKey;
+
+static CritKey critKey(const Book* b, int field)
+{
+    CritKey k;
+    k.book = b;
+    k.text = field == FIELD_AUTHOR ? b->author : b->title;
+    k.len = strnlen(k.text, 49);
+    return k;
+}
+
+static int keyByte(const CritKey* k, uint32_t i)
+{
+    if(i < k->len)
+        return tolower((unsigned char)k->text[i]);
+    if(i == k->len)
+        return 0;
+    if(i <= k->len + sizeof(Book*))
+        return (int)(((uintptr_t)k->book >> (8 * (i - k->len - 1))) & 0xFF);
+    return 0;
+}
+
+static int critDirection(const CritNode* q, int c)
+{
+    return (1 + (q->otherbits | c)) >> 8;
+}
+
+static void prefixInsert(Book* book, int field)
+{
+    if(!critArena.objSize)
+        arenaInit(&critArena, sizeof(CritNode));
+    if(!prefixRoot[field]) {
+        prefixRoot[field] = book;
+        return;
+    }
+
+    // Find the closest existing leaf
+    CritKey key = critKey(book, field);
+    void* p = prefixRoot[field];
+    while(isInternal(p)) {
+        CritNode* q = critNode(p);
+        p = q->child[critDirection(q, keyByte(&key, q->byte))];
+    }
+    CritKey best = critKey((Book*)p, field);
+
+    // First differing byte and bit between the new key and that leaf
+    uint32_t newByte = 0;
+    int diff = 0;
+    for(;; newByte++) {
+        diff = keyByte(&best, newByte) ^ keyByte(&key, newByte);
+        if(diff)
+            break;
+        if(newByte > 49 + sizeof(Book*))
+            return; // same book already present
+    }
+    diff |= diff >> 1;
+    diff |= diff >> 2;
+    diff |= diff >> 4;
+    uint8_t newOther = (uint8_t)((diff & ~(diff >> 1)) ^ 255);
+    int newDir = (1 + (newOther | keyByte(&best, newByte))) >> 8;
+
+    CritNode* n = (CritNode*)arenaAlloc(&critArena);
+    n->byte = newByte;
+    n->otherbits = newOther;
+    n->child[1 - newDir] = book;
+
+    // Splice the new node in where its critical bit belongs
+    void** where = &prefixRoot[field];
+    for(;;) {
+        p = *where;
+        if(!isInternal(p))
+            break;
+        CritNode* q = critNode(p);
+        if(q->byte > newByte || (q->byte == newByte && q->otherbits > newOther))
+            break;
+        where = &q->child[critDirection(q, keyByte(&key, q->byte))];
+    }
+    n->child[newDir] = *where;
+    *where = (void*)((uintptr_t)n + 1);
+}
+
+static void prefixRemove(Book* book, int field)
+{
+    void** where = &prefixRoot[field];
+    void** whereParent = NULL;
+    CritNode* q = NULL;
+    int dir = 0;
+    void* p = *where;
+    if(!p)
+        return;
+
+    CritKey key = critKey(book, field);
+    while(isInternal(p)) {
+        whereParent = where;
+        q = critNode(p);
+        dir = critDirection(q, keyByte(&key, q->byte));
+        where = &q->child[dir];
+        p = *where;
+    }
+    if(p != book)
+        return;
+    if(!whereParent) {
+        *where = NULL;
+        return;
+    }
+    *whereParent = q->child[1 - dir];
+    arenaFree(&critArena, q);
+}
+
+
+#define PREFIX_KEY_MAX (49 + 1 + sizeof(Book*))
+
+typedef struct PrefixKey
+{
+    uint8_t bytes[PREFIX_KEY_MAX];  // keyByte 0 on, so memcmp sorts like the tree
+    Book* book;
+} PrefixKey;
+
+static int comparePrefixKeys(const void* a, const void* b)
+{
+    return memcmp(((const PrefixKey*)a)->bytes, ((const PrefixKey*)b)->bytes, PREFIX_KEY_MAX);
+}
+
+// Build an empty tree from n books at once: sort the keys, then each
+// internal node is the critical bit between two neighbours, and the
+// tree is the Cartesian tree of those bits, made with one stack pass.
+// A tree that already has books takes them one insert at a time.
+static void prefixBuild(Book* const* books, size_t n, int field)
+{
+    if(prefixRoot[field] || n < 2) {
+        for(size_t i = 0; i < n; i++)
+            prefixInsert(books[i], field);
+        return;
+    }
+    if(!critArena.objSize)
+        arenaInit(&critArena, sizeof(CritNode));
+    PrefixKey* keys = (PrefixKey*)malloc(sizeof(PrefixKey) * n);
+    CritNode** stack = (CritNode**)malloc(sizeof(CritNode*) * n);
+    if(!keys || !stack) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < n; i++) {
+        CritKey k = critKey(books[i], field);
+        for(uint32_t j = 0; j < PREFIX_KEY_MAX; j++)
+            keys[i].bytes[j] = (uint8_t)keyByte(&k, j);
+        keys[i].book = books[i];
+    }
+    qsort(keys, n, sizeof(PrefixKey), comparePrefixKeys);
+
+    size_t depth = 0;
+    for(size_t i = 1; i < n; i++) {
+        const uint8_t* prev = keys[i - 1].bytes;
+        const uint8_t* next = keys[i].bytes;
+        uint32_t byte = 0;
+        while(byte < PREFIX_KEY_MAX && prev[byte] == next[byte])
+            byte++;
+        if(byte == PREFIX_KEY_MAX)
+            continue; // the same book twice
+        int diff = prev[byte] ^ next[byte];
+        diff |= diff >> 1;
+        diff |= diff >> 2;
+        diff |= diff >> 4;
+        uint8_t other = (uint8_t)((diff & ~(diff >> 1)) ^ 255);
+
+        // Nodes for later bits than this one become its left subtree
+        void* sub = keys[i - 1].book;
+        while(depth) {
+            CritNode* top = stack[depth - 1];
+            if(top->byte < byte || (top->byte == byte && top->otherbits < other))
+                break;
+            top->child[1] = sub;
+            sub = (void*)((uintptr_t)top + 1);
+            depth--;
+        }
+        CritNode* node = (CritNode*)arenaAlloc(&critArena);
+        node->byte = byte;
+        node->otherbits = other;
+        node->child[0] = sub;
+        stack[depth++] = node;
+    }
+    void* sub = keys[n - 1].book;
+    while(depth) {
+        CritNode* top = stack[--depth];
+        top->child[1] = sub;
+        sub = (void*)((uintptr_t)top + 1);
+    }
+    prefixRoot[field] = sub;
+    free(keys);
+    free(stack);
+}
+
+static int visitSubtree(void* p, int (*visit)(Book*, void*), void* ctx)
+{
+    while(isInternal(p)) {
+        CritNode* q = critNode(p);
+        if(!visitSubtree(q->child[0], visit, ctx))
+            return 0;
+        p = q->child[1];
+    }
+    return visit((Book*)p, ctx);
+}
+
+static void prefixWalk(int field, const char* prefix, int (*visit)(Book*, void*), void* ctx)
+{
+    void* p = prefixRoot[field];
+    if(!p)
+        return;
+    size_t plen = strlen(prefix);
+    void* top = p;
+
+    while(isInternal(p)) {
+        CritNode* q = critNode(p);
+        int c = q->byte < plen ? tolower((unsigned char)prefix[q->byte]) : 0;
+        p = q->child[critDirection(q, c)];
+        if(q->byte < plen)
+            top = p;
+    }
+    CritKey key = critKey((Book*)p, field);
+    for(size_t i = 0; i < plen; i++) {
+        if(keyByte(&key, (uint32_t)i) != tolower((unsigned char)prefix[i]))
+            return;
+    }
+    visitSubtree(top, visit, ctx);
+}
+
+// Calls visit(book, ctx) for every book whose field starts with `prefix`
+// (case-insensitive), in alphabetical order. visit returns 0 to stop and
+// must not change the catalog: it runs with the index locked.
+void searchPrefix(int field, const char* prefix, int (*visit)(Book*, void*), void* ctx)
+{
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    prefixWalk(field, prefix, visit, ctx);
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+}
+
+static void freePrefixIndex(void)
+{
+    arenaRelease(&critArena);
+    prefixRoot[FIELD_TITLE] = prefixRoot[FIELD_AUTHOR] = NULL;
+}
+
+// --- Keyword Index ---
+// Inverted index from lowercase words of titles and authors to the IDs of
+// books containing them. Each posting list is a sorted run of blocks;
+// a block stores its first ID raw and the rest as varint deltas, so
+// dense ID ranges cost about a byte per posting. A copy with the same ID
+// adds a zero delta, which keeps deletes of one copy exact.
+// Appends of increasing IDs extend the last block without decoding it;
+// other updates scan one block to the ID and splice the deltas next to
+// it in place. A block splits past 2 * POSTING_BLOCK postings, and one
+// that drops under a quarter of POSTING_BLOCK joins a neighbour with room.
+// Postings name IDs, not records: when one ID has records with different
+// titles, a hit is checked against each record's own words.
+
+#define POSTING_BLOCK 128
+#define TERM_MIN_CAPACITY 1024
+#define MAX_TOKENS 50
+
+typedef struct PostingBlock
+{
+    int first;
+    int last;
+    int count;
+    uint32_t bytes;       // size of the encoded deltas
+    uint32_t capacity;
+    unsigned char* data;
+} PostingBlock;
+
+typedef struct PostingList
+{
+    PostingBlock* blocks;
+    int blockCount;
+    int blockCapacity;
+    long total;
+} PostingList;
+
+typedef struct TermEntry
+{
+    unsigned int hash;
+    char* term;           // NULL = empty slot
+    PostingList list;
+} TermEntry;
+
+typedef struct TermDictionary
+{
+    TermEntry* slots;
+    size_t capacity;
+    size_t count;
+} TermDictionary;
+
+static TermDictionary termDict;
+
+static size_t putVarint(unsigned char* p, uint32_t v)
+{
+    size_t n = 0;
+    while(v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+static const unsigned char* getVarint(const unsigned char* p, uint32_t* v)
+{
+    uint32_t d = 0;
+    int shift = 0;
+    while(*p & 0x80) {
+        d |= (uint32_t)(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    *v = d | (uint32_t)*p++ << shift;
+    return p;
+}
+
+// Decode a block into out[]; with `unique` set, repeated IDs appear once
+static int decodeBlock(const PostingBlock* b, int* out, int unique)
+{
+    int n = 0, v = b->first;
+    out[n++] = v;
+    const unsigned char* p = b->data;
+    const unsigned char* end = p + b->bytes;
+    while(p < end) {
+        uint32_t d;
+        p = getVarint(p, &d);
+        v += (int)d;
+        if(!unique || d)
+            out[n++] = v;
+    }
+    return n;
+}
+
+static void blockReserve(PostingBlock* b, uint32_t bytes)
+{
+    if(bytes <= b->capacity)
+        return;
+    uint32_t cap = b->capacity ? b->capacity : 16;
+    while(cap < bytes)
+        cap *= 2;
+    b->data = (unsigned char*)realloc(b->data, cap);
+    if(!b->data) {
+        printf("Out of memory while growing postings!\n");
+        exit(1);
+    }
+    b->capacity = cap;
+}
+
+static void encodeBlock(PostingBlock* b, const int* ids, int n)
+{
+    blockReserve(b, (uint32_t)n * 5);
+    b->first = ids[0];
+    b->last = ids[n - 1];
+    b->count = n;
+    b->bytes = 0;
+    for(int i = 1; i < n; i++)
+        b->bytes += (uint32_t)putVarint(b->data + b->bytes, (uint32_t)(ids[i] - ids[i - 1]));
+}
+
+// Last block whose first ID is <= id (0 if id is below every block)
+static int findBlock(const PostingList* pl, int id)
+{
+    int lo = 0, hi = pl->blockCount - 1;
+    while(lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if(pl->blocks[mid].first <= id)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static PostingBlock* insertBlockAt(PostingList* pl, int at)
+{
+    if(pl->blockCount == pl->blockCapacity) {
+        pl->blockCapacity = pl->blockCapacity ? pl->blockCapacity * 2 : 4;
+        pl->blocks = (PostingBlock*)realloc(pl->blocks, sizeof(PostingBlock) * (size_t)pl->blockCapacity);
+        if(!pl->blocks) {
+            printf("Out of memory while growing postings!\n");
+            exit(1);
+        }
+    }
+    memmove(pl->blocks + at + 1, pl->blocks + at, sizeof(PostingBlock) * (size_t)(pl->blockCount - at));
+    pl->blockCount++;
+    memset(&pl->blocks[at], 0, sizeof(PostingBlock));
+    return &pl->blocks[at];
+}
+
+// Replace bytes [from, to) of a block's deltas with the varints of
+// d[0..n-1]
+static void spliceDeltas(PostingBlock* b, uint32_t from, uint32_t to, const uint32_t* d, int n)
+{
+    unsigned char put[10];
+    uint32_t len = 0;
+    for(int i = 0; i < n; i++)
+        len += (uint32_t)putVarint(put + len, d[i]);
+    blockReserve(b, b->bytes - (to - from) + len);
+    memmove(b->data + from + len, b->data + to, b->bytes - to);
+    memcpy(b->data + from, put, len);
+    b->bytes = b->bytes - (to - from) + len;
+}
+
+static void postingAdd(PostingList* pl, int id)
+{
+    pl->total++;
+    if(!pl->blockCount) {
+        PostingBlock* b = insertBlockAt(pl, 0);
+        b->first = b->last = id;
+        b->count = 1;
+        return;
+    }
+
+    int at = findBlock(pl, id);
+    PostingBlock* b = &pl->blocks[at];
+    if(at == pl->blockCount - 1 && id >= b->last) {
+        // Common case: append to the tail block without decoding it
+        if(b->count >= POSTING_BLOCK) {
+            b = insertBlockAt(pl, at + 1);
+            b->first = b->last = id;
+            b->count = 1;
+            return;
+        }
+        blockReserve(b, b->bytes + 5);
+        b->bytes += (uint32_t)putVarint(b->data + b->bytes, (uint32_t)(id - b->last));
+        b->last = id;
+        b->count++;
+        return;
+    }
+
+    if(id < b->first) {
+        // New head of the first block
+        uint32_t d = (uint32_t)(b->first - id);
+        spliceDeltas(b, 0, 0, &d, 1);
+        b->first = id;
+    } else {
+        // Find the first posting above id and split its delta in two
+        int prev = b->first;
+        const unsigned char* p = b->data;
+        const unsigned char* end = p + b->bytes;
+        while(p < end) {
+            uint32_t d;
+            const unsigned char* next = getVarint(p, &d);
+            if(prev + (int)d > id) {
+                uint32_t parts[2] = { (uint32_t)(id - prev), (uint32_t)(prev + (int)d - id) };
+                spliceDeltas(b, (uint32_t)(p - b->data), (uint32_t)(next - b->data), parts, 2);
+                break;
+            }
+            prev += (int)d;
+            p = next;
+        }
+        if(p == end) {
+            uint32_t d = (uint32_t)(id - b->last);
+            spliceDeltas(b, b->bytes, b->bytes, &d, 1);
+            b->last = id;
+        }
+    }
+    if(++b->count <= 2 * POSTING_BLOCK)
+        return;
+
+    // Split an overfull block in two
+    int ids[2 * POSTING_BLOCK + 1];
+    int n = decodeBlock(b, ids, 0);
+    encodeBlock(b, ids, n / 2);
+    PostingBlock* right = insertBlockAt(pl, at + 1);
+    encodeBlock(right, ids + n / 2, n - n / 2);
+}
+
+// Append block at + 1 to block at and drop it
+static void mergeBlocks(PostingList* pl, int at)
+{
+    PostingBlock* left = &pl->blocks[at];
+    PostingBlock* right = &pl->blocks[at + 1];
+    blockReserve(left, left->bytes + 5 + right->bytes);
+    left->bytes += (uint32_t)putVarint(left->data + left->bytes, (uint32_t)(right->first - left->last));
+    memcpy(left->data + left->bytes, right->data, right->bytes);
+    left->bytes += right->bytes;
+    left->last = right->last;
+    left->count += right->count;
+    free(right->data);
+    memmove(right, right + 1, sizeof(PostingBlock) * (size_t)(pl->blockCount - at - 2));
+    pl->blockCount--;
+}
+
+static void postingRemove(PostingList* pl, int id)
+{
+    if(!pl->blockCount)
+        return;
+    int at = findBlock(pl, id);
+    PostingBlock* b = &pl->blocks[at];
+    if(id < b->first || id > b->last)
+        return;
+
+    if(b->count == 1) {
+        pl->total--;
+        free(b->data);
+        memmove(pl->blocks + at, pl->blocks + at + 1, sizeof(PostingBlock) * (size_t)(pl->blockCount - at - 1));
+        pl->blockCount--;
+        return;
+    }
+    if(id == b->first) {
+        // The next posting becomes the head
+        uint32_t d;
+        const unsigned char* next = getVarint(b->data, &d);
+        spliceDeltas(b, 0, (uint32_t)(next - b->data), NULL, 0);
+        b->first += (int)d;
+    } else {
+        // Find the posting and fold its delta into the next one's
+        int prev = b->first;
+        const unsigned char* p = b->data;
+        const unsigned char* end = p + b->bytes;
+        for(;;) {
+            if(p == end)
+                return;
+            uint32_t d;
+            const unsigned char* next = getVarint(p, &d);
+            if(prev + (int)d > id)
+                return;
+            if(prev + (int)d < id) {
+                prev += (int)d;
+                p = next;
+                continue;
+            }
+            uint32_t from = (uint32_t)(p - b->data);
+            if(next == end) {
+                spliceDeltas(b, from, b->bytes, NULL, 0);
+                b->last = prev;
+            } else {
+                uint32_t d2;
+                next = getVarint(next, &d2);
+                d += d2;
+                spliceDeltas(b, from, (uint32_t)(next - b->data), &d, 1);
+            }
+            break;
+        }
+    }
+    b->count--;
+    pl->total--;
+
+    // Keep blocks from thinning out under a run of deletes
+    if(b->count >= POSTING_BLOCK / 4)
+        return;
+    if(at > 0 && pl->blocks[at - 1].count + b->count <= POSTING_BLOCK)
+        mergeBlocks(pl, at - 1);
+    else if(at + 1 < pl->blockCount && pl->blocks[at + 1].count + b->count <= POSTING_BLOCK)
+        mergeBlocks(pl, at);
+}
+
+static void termDictGrow(void)
+{
+    size_t newCap = termDict.capacity ? termDict.capacity * 2 : TERM_MIN_CAPACITY;
+    TermEntry* slots = (TermEntry*)calloc(newCap, sizeof(TermEntry));
+    if(!slots) {
+        printf("Out of memory while growing keyword index!\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < termDict.capacity; i++) {
+        TermEntry* e = &termDict.slots[i];
+        if(!e->term)
+            continue;
+        size_t j = e->hash & (newCap - 1);
+        while(slots[j].term)
+            j = (j + 1) & (newCap - 1);
+        slots[j] = *e;
+    }
+    free(termDict.slots);
+    termDict.slots = slots;
+    termDict.capacity = newCap;
+}
+
+// Posting list for a term; created on demand when `create` is set
+static PostingList* termList(const char* term, size_t len, int create)
+{
+    if(!termDict.capacity) {
+        if(!create)
+            return NULL;
+        termDictGrow();
+    }
+    unsigned int h = hashName(term, len);
+    size_t mask = termDict.capacity - 1;
+    size_t i = h & mask;
+    while(termDict.slots[i].term) {
+        TermEntry* e = &termDict.slots[i];
+        if(e->hash == h && strncmp(e->term, term, len) == 0 && !e->term[len])
+            return &e->list;
+        i = (i + 1) & mask;
+    }
+    if(!create)
+        return NULL;
+    if((termDict.count + 1) * 10 > termDict.capacity * 7) {
+        termDictGrow();
+        return termList(term, len, create);
+    }
+    TermEntry* e = &termDict.slots[i];
+    e->hash = h;
+    e->term = (char*)malloc(len + 1);
+    memcpy(e->term, term, len);
+    e->term[len] = 0;
+    termDict.count++;
+    return &e->list;
+}
+
+// Split text into lowercase alphanumeric words, skipping ones already seen
+static int tokenize(const char* text, char tokens[][50], int n)
+{
+    while(*text) {
+        while(*text && !isalnum((unsigned char)*text))
+            text++;
+        int len = 0;
+        char word[50];
+        while(isalnum((unsigned char)*text)) {
+            if(len < 49)
+                word[len++] = (char)tolower((unsigned char)*text);
+            text++;
+        }
+        if(!len)
+            continue;
+        word[len] = 0;
+        int seen = 0;
+        for(int i = 0; i < n && !seen; i++)
+            seen = strcmp(tokens[i], word) == 0;
+        if(!seen && n < MAX_TOKENS)
+            strcpy(tokens[n++], word);
+    }
+    return n;
+}
+
+static int bookTokens(const Book* b, char tokens[][50])
+{
+    int n = tokenize(b->title, tokens, 0);
+    return tokenize(b->author, tokens, n);
+}
+
+static void indexKeywords(Book* b)
+{
+    char tokens[MAX_TOKENS][50];
+    int n = bookTokens(b, tokens);
+    for(int i = 0; i < n; i++)
+        postingAdd(termList(tokens[i], strlen(tokens[i]), 1), b->id);
+}
+
+static void unindexKeywords(Book* b)
+{
+    char tokens[MAX_TOKENS][50];
+    int n = bookTokens(b, tokens);
+    for(int i = 0; i < n; i++) {
+        PostingList* pl = termList(tokens[i], strlen(tokens[i]), 0);
+        if(pl)
+            postingRemove(pl, b->id);
+    }
+}
+
+// Intersect two sorted arrays of distinct IDs into out. With SSE2 each
+// step compares 4 IDs of `a` against all 4 rotations of 4 IDs of `b`.
+static size_t intersectSorted(const int* a, size_t na, const int* b, size_t nb, int* out)
+{
+    size_t i = 0, j = 0, k = 0;
+#ifdef __SSE2__
+    while(i + 4 <= na && j + 4 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(m));
+        while(mask) {
+            out[k++] = a[i + (size_t)__builtin_ctz((unsigned)mask)];
+            mask &= mask - 1;
+        }
+        int amax = a[i + 3], bmax = b[j + 3];
+        if(amax <= bmax)
+            i += 4;
+        if(bmax <= amax)
+            j += 4;
+    }
+#endif
+    while(i < na && j < nb) {
+        if(a[i] < b[j])
+            i++;
+        else if(a[i] > b[j])
+            j++;
+        else {
+            out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return k;
+}
+
+// Intersect sorted distinct IDs with a posting list, decoding only the
+// blocks whose ID range overlaps the candidates
+static size_t intersectWithList(const int* cur, size_t n, const PostingList* pl, int* out)
+{
+    int ids[2 * POSTING_BLOCK + 1];
+    size_t i = 0, k = 0;
+    for(int bi = 0; bi < pl->blockCount && i < n; bi++) {
+        const PostingBlock* b = &pl->blocks[bi];
+        if(b->last < cur[i])
+            continue;
+        if(b->first > cur[n - 1])
+            break;
+        while(i < n && cur[i] < b->first)
+            i++;
+        size_t end = i;
+        while(end < n && cur[end] <= b->last)
+            end++;
+        if(end == i)
+            continue;
+        int m = decodeBlock(b, ids, 1);
+        k += intersectSorted(cur + i, end - i, ids, (size_t)m, out + k);
+        i = end;
+    }
+    return k;
+}
+
+// Does the book's title or author contain every one of the words?
+static int bookHasWords(const Book* b, char words[][50], int n)
+{
+    char tokens[MAX_TOKENS][50];
+    int m = bookTokens(b, tokens);
+    for(int i = 0; i < n; i++) {
+        int seen = 0;
+        for(int j = 0; j < m && !seen; j++)
+            seen = strcmp(tokens[j], words[i]) == 0;
+        if(!seen)
+            return 0;
+    }
+    return 1;
+}
+
+// Whether some record of `id` has all the words by itself. Only IDs with
+// several records need their words read.
+static int idHasWords(int id, char words[][50], int n)
+{
+    size_t mask = bookIndex.capacity - 1;
+    size_t first = hashId(id) & mask;
+    int records = 0;
+    for(size_t j = first; bookIndex.slots[j].book; j = (j + 1) & mask)
+        records += bookIndex.slots[j].id == id;
+    if(records <= 1)
+        return records;
+    for(size_t j = first; bookIndex.slots[j].book; j = (j + 1) & mask) {
+        if(bookIndex.slots[j].id == id && bookHasWords(bookIndex.slots[j].book, words, n))
+            return 1;
+    }
+    return 0;
+}
+
+static int compareListSize(const void* a, const void* b)
+{
+    long x = (*(PostingList* const*)a)->total, y = (*(PostingList* const*)b)->total;
+    return (x > y) - (x < y);
+}
+
+static size_t keywordIds(const char* query, int** ids)
+{
+    char tokens[MAX_TOKENS][50];
+    PostingList* lists[MAX_TOKENS];
+    int n = tokenize(query, tokens, 0);
+    *ids = NULL;
+    if(!n)
+        return 0;
+    for(int t = 0; t < n; t++) {
+        lists[t] = termList(tokens[t], strlen(tokens[t]), 0);
+        if(!lists[t] || !lists[t]->total)
+            return 0;
+    }
+    // Start from the rarest word so candidates shrink fastest
+    qsort(lists, (size_t)n, sizeof(PostingList*), compareListSize);
+
+    int* cur = (int*)malloc(sizeof(int) * (size_t)lists[0]->total);
+    int* next = (int*)malloc(sizeof(int) * (size_t)lists[0]->total);
+    size_t count = 0;
+    for(int bi = 0; bi < lists[0]->blockCount; bi++) {
+        int m = decodeBlock(&lists[0]->blocks[bi], cur + count, 1);
+        // drop an ID repeated across the block boundary
+        if(count && cur[count] == cur[count - 1]) {
+            memmove(cur + count, cur + count + 1, sizeof(int) * (size_t)(m - 1));
+            m--;
+        }
+        count += (size_t)m;
+    }
+    for(int t = 1; t < n && count; t++) {
+        count = intersectWithList(cur, count, lists[t], next);
+        int* swap = cur;
+        cur = next;
+        next = swap;
+    }
+    free(next);
+    if(n > 1) {
+        size_t kept = 0;
+        for(size_t i = 0; i < count; i++) {
+            if(idHasWords(cur[i], tokens, n))
+                cur[kept++] = cur[i];
+        }
+        count = kept;
+    }
+    *ids = cur;
+    return count;
+}
+
+// IDs of books containing every word of `query`, ascending. The caller
+// frees *ids. Returns the number of IDs.
+size_t searchKeywords(const char* query, int** ids)
+{
+    pthread_rwlock_rdlock(&indexLock);
+    size_t n = keywordIds(query, ids);
+    pthread_rwlock_unlock(&indexLock);
+    return n;
+}
+
+static void freeKeywordIndex(void)
+{
+    for(size_t i = 0; i < termDict.capacity; i++) {
+        TermEntry* e = &termDict.slots[i];
+        if(!e->term)
+            continue;
+        for(int b = 0; b < e->list.blockCount; b++)
+            free(e->list.blocks[b].data);
+        free(e->list.blocks);
+        free(e->term);
+    }
+    free(termDict.slots);
+    memset(&termDict, 0, sizeof(termDict));
+}
+
+// --- Substring Scan ---
+// Titles and authors are also copied into one contiguous arena as
+// "title\0author\0" records, so "contains" searches stream through memory
+// instead of chasing Book pointers. Kernels find candidate positions by
+// matching the needle's first and last byte (either case) 16 or 32 bytes
+// at a time and verify only those. The kernel is picked at runtime from
+// what the CPU supports. Deleted records stay as dead bytes until they
+// outweigh the live ones, then the arena is compacted.
+
+typedef struct TextArena
+{
+    char* text;
+    size_t used;
+    size_t capacity;
+    size_t* recStart;     // record -> offset in text, ascending
+    Book** recOwner;      // record -> book, NULL once deleted
+    uint32_t recCount;
+    uint32_t recCapacity;
+    size_t deadBytes;
+} TextArena;
+
+typedef size_t (*ScanKernel)(const char* buf, size_t from, size_t size, const char* needle, size_t m);
+
+static TextArena textArena;
+static ScanKernel scanKernel;
+static const char* scanKernelName;
+
+static void textArenaAdd(Book* b)
+{
+    size_t tlen = strlen(b->title), alen = strlen(b->author);
+    size_t need = textArena.used + tlen + alen + 2;
+    if(need > textArena.capacity) {
+        size_t cap = textArena.capacity ? textArena.capacity : (1 << 16);
+        while(cap < need)
+            cap *= 2;
+        textArena.text = (char*)realloc(textArena.text, cap);
+        textArena.capacity = cap;
+    }
+    if(textArena.recCount == textArena.recCapacity) {
+        textArena.recCapacity = textArena.recCapacity ? textArena.recCapacity * 2 : 1024;
+        textArena.recStart = (size_t*)realloc(textArena.recStart, sizeof(size_t) * textArena.recCapacity);
+        textArena.recOwner = (Book**)realloc(textArena.recOwner, sizeof(Book*) * textArena.recCapacity);
+    }
+    if(!textArena.text || !textArena.recStart || !textArena.recOwner) {
+        printf("Out of memory while growing text arena!\n");
+        exit(1);
+    }
+    char* p = textArena.text + textArena.used;
+    memcpy(p, b->title, tlen + 1);
+    memcpy(p + tlen + 1, b->author, alen + 1);
+    b->textRec = textArena.recCount;
+    textArena.recStart[textArena.recCount] = textArena.used;
+    textArena.recOwner[textArena.recCount++] = b;
+    textArena.used = need;
+}
+
+static size_t textRecordEnd(uint32_t rec)
+{
+    return rec + 1 < textArena.recCount ? textArena.recStart[rec + 1] : textArena.used;
+}
+
+static void textArenaCompact(void)
+{
+    size_t out = 0;
+    uint32_t live = 0;
+    for(uint32_t r = 0; r < textArena.recCount; r++) {
+        Book* owner = textArena.recOwner[r];
+        if(!owner)
+            continue;
+        size_t start = textArena.recStart[r], len = textRecordEnd(r) - start;
+        memmove(textArena.text + out, textArena.text + start, len);
+        textArena.recStart[live] = out;
+        textArena.recOwner[live] = owner;
+        owner->textRec = live++;
+        out += len;
+    }
+    textArena.used = out;
+    textArena.recCount = live;
+    textArena.deadBytes = 0;
+}
+
+static void textArenaRemove(Book* b)
+{
+    uint32_t r = b->textRec;
+    textArena.recOwner[r] = NULL;
+    textArena.deadBytes += textRecordEnd(r) - textArena.recStart[r];
+    if(textArena.deadBytes > (1 << 20) && textArena.deadBytes * 2 > textArena.used)
+        textArenaCompact();
+}
+
+// Record containing byte `pos`
+static uint32_t textRecordAt(size_t pos)
+{
+    uint32_t lo = 0, hi = textArena.recCount - 1;
+    while(lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if(textArena.recStart[mid] <= pos)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+// Each kernel returns the first verified match at or after `from`, or size
+static size_t scanScalar(const char* buf, size_t from, size_t size, const char* needle, size_t m)
+{
+    int first = tolower((unsigned char)needle[0]);
+    for(size_t i = from; i + m <= size; i++) {
+        if(tolower((unsigned char)buf[i]) == first && strncasecmp(buf + i, needle, m) == 0)
+            return i;
+    }
+    return size;
+}
+
+#ifdef __SSE2__
+static size_t scanSse2(const char* buf, size_t from, size_t size, const char* needle, size_t m)
+{
+    const __m128i f1 = _mm_set1_epi8((char)tolower((unsigned char)needle[0]));
+    const __m128i f2 = _mm_set1_epi8((char)toupper((unsigned char)needle[0]));
+    const __m128i l1 = _mm_set1_epi8((char)tolower((unsigned char)needle[m - 1]));
+    const __m128i l2 = _mm_set1_epi8((char)toupper((unsigned char)needle[m - 1]));
+    size_t i = from;
+    while(i + m - 1 + 16 <= size) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(buf + i + m - 1));
+        __m128i hit = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(a, f1), _mm_cmpeq_epi8(a, f2)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(b, l1), _mm_cmpeq_epi8(b, l2)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        while(mask) {
+            size_t p = i + (size_t)__builtin_ctz(mask);
+            if(strncasecmp(buf + p, needle, m) == 0)
+                return p;
+            mask &= mask - 1;
+        }
+        i += 16;
+    }
+    return scanScalar(buf, i, size, needle, m);
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static size_t scanAvx2(const char* buf, size_t from, size_t size, const char* needle, size_t m)
+{
+    const __m256i f1 = _mm256_set1_epi8((char)tolower((unsigned char)needle[0]));
+    const __m256i f2 = _mm256_set1_epi8((char)toupper((unsigned char)needle[0]));
+    const __m256i l1 = _mm256_set1_epi8((char)tolower((unsigned char)needle[m - 1]));
+    const __m256i l2 = _mm256_set1_epi8((char)toupper((unsigned char)needle[m - 1]));
+    size_t i = from;
+    while(i + m - 1 + 32 <= size) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(buf + i + m - 1));
+        __m256i hit = _mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi8(a, f1), _mm256_cmpeq_epi8(a, f2)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(b, l1), _mm256_cmpeq_epi8(b, l2)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        while(mask) {
+            size_t p = i + (size_t)__builtin_ctz(mask);
+            if(strncasecmp(buf + p, needle, m) == 0)
+                return p;
+            mask &= mask - 1;
+        }
+        i += 32;
+    }
+    return scanScalar(buf, i, size, needle, m);
+}
+#endif
+
+// Pick a kernel by name ("scalar", "sse2", "avx2"), or the best the CPU
+// supports when name is NULL. Returns 0 if the named kernel is unavailable.
+int selectScanKernel(const char* name)
+{
+    int any = !name;
+#ifdef HAVE_AVX2_KERNEL
+    if((any || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        scanKernelName = "avx2";
+        __atomic_store_n(&scanKernel, scanAvx2, __ATOMIC_RELEASE);
+        return 1;
+    }
+#endif
+#ifdef __SSE2__
+    if(any || strcmp(name, "sse2") == 0) {
+        scanKernelName = "sse2";
+        __atomic_store_n(&scanKernel, scanSse2, __ATOMIC_RELEASE);
+        return 1;
+    }
+#endif
+    if(any || strcmp(name, "scalar") == 0) {
+        scanKernelName = "scalar";
+        __atomic_store_n(&scanKernel, scanScalar, __ATOMIC_RELEASE);
+        return 1;
+    }
+    return 0;
+}
+
+static size_t scanText(const char* needle, int (*visit)(Book*, void*), void* ctx)
+{
+    size_t m = strlen(needle);
+    if(!m || !textArena.recCount)
+        return 0;
+    if(!__atomic_load_n(&scanKernel, __ATOMIC_ACQUIRE))
+        selectScanKernel(NULL);
+
+    ScanKernel kernel = __atomic_load_n(&scanKernel, __ATOMIC_ACQUIRE);
+    size_t pos = 0, size = textArena.used;
+    while(pos < size) {
+        pos = kernel(textArena.text, pos, size, needle, m);
+        if(pos >= size)
+            break;
+        uint32_t rec = textRecordAt(pos);
+        Book* owner = textArena.recOwner[rec];
+        if(owner && !visit(owner, ctx))
+            break;
+        pos = textRecordEnd(rec); // one report per book
+    }
+    return size;
+}
+
+// Calls visit(book, ctx) once for every book whose title or author
+// contains `needle` (ASCII case-insensitive). Returns bytes scanned.
+// Like searchPrefix, visit runs with the index locked.
+size_t searchSubstring(const char* needle, int (*visit)(Book*, void*), void* ctx)
+{
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    size_t bytes = scanText(needle, visit, ctx);
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    return bytes;
+}
+
+static void freeTextArena(void)
+{
+    free(textArena.text);
+    free(textArena.recStart);
+    free(textArena.recOwner);
+    memset(&textArena, 0, sizeof(textArena));
+}
+
+// Keep the text search indexes in step with the catalog
+static void indexText(Book* book)
+{
+    prefixInsert(book, FIELD_TITLE);
+    prefixInsert(book, FIELD_AUTHOR);
+    indexKeywords(book);
+    textArenaAdd(book);
+}
+
+static void unindexText(Book* book)
+{
+    prefixRemove(book, FIELD_TITLE);
+    prefixRemove(book, FIELD_AUTHOR);
+    unindexKeywords(book);
+    textArenaRemove(book);
+}
+
+// --- Loans ---
+// Each issued copy can carry a loan: borrower, issue time and due time.
+// Loans live in a table and the title's index entry holds the newest
+// one, chained to the title's older loans, so issue and return never
+// touch the Book node. A return closes the loan of the patron bringing
+// the copy back, or the title's oldest loan when the desk doesn't say who
+// (first issued, first due back). Open loans also sit in a
+// binary min-heap on due time, so "what is overdue" walks only the part
+// of the heap that is due, and a return removes its entry in O(log n)
+// through the slot's heap position. Books issued without a borrower
+// (imports, old snapshots) simply have no loan. Tables are per loan
+// stripe (see below): the on-shelf count and the loans of a title change
+// together under its stripe's lock, so a title never has more loans open
+// than copies out.
+
+#define LOAN_DAYS 14
+#define LOAN_MIN_CAPACITY 64
+
+// Heap entries carry the due time, so sifting stays inside the heap array
+typedef struct LoanHeapEntry
+{
+    time_t dueAt;
+    uint32_t slot;
+} LoanHeapEntry;
+
+typedef struct LoanTable
+{
+    Loan* slots;
+    uint32_t* heapPos;    // slot -> heap position; free slots chain here
+    LoanHeapEntry* heap;  // earliest due first
+    uint32_t count;       // open loans (= heap size)
+    uint32_t used;        // slots handed out so far
+    uint32_t capacity;
+    uint32_t freeSlot;    // first free slot + 1
+} LoanTable;
+
+static void heapSet(LoanTable* t, uint32_t pos, LoanHeapEntry e)
+{
+    t->heap[pos] = e;
+    t->heapPos[e.slot] = pos;
+}
+
+static void heapUp(LoanTable* t, uint32_t pos)
+{
+    LoanHeapEntry e = t->heap[pos];
+    while(pos > 0 && e.dueAt < t->heap[(pos - 1) / 2].dueAt) {
+        heapSet(t, pos, t->heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    heapSet(t, pos, e);
+}
+
+static void heapDown(LoanTable* t, uint32_t pos)
+{
+    LoanHeapEntry e = t->heap[pos];
+    for(;;) {
+        uint32_t child = 2 * pos + 1;
+        if(child >= t->count)
+            break;
+        if(child + 1 < t->count && t->heap[child + 1].dueAt < t->heap[child].dueAt)
+            child++;
+        if(t->heap[child].dueAt >= e.dueAt)
+            break;
+        heapSet(t, pos, t->heap[child]);
+        pos = child;
+    }
+    heapSet(t, pos, e);
+}
+
+// `t` is the table of the slot's stripe; caller holds the stripe lock
+static void loanOpen(LoanTable* t, BookSlot* s, const char* borrower, time_t issuedAt, time_t dueAt)
+{
+    uint32_t slot;
+    if(t->freeSlot) {
+        slot = t->freeSlot - 1;
+        t->freeSlot = t->heapPos[slot];
+    } else {
+        if(t->used == t->capacity) {
+            t->capacity = t->capacity ? t->capacity * 2 : LOAN_MIN_CAPACITY;
+            t->slots = (Loan*)realloc(t->slots, sizeof(Loan) * t->capacity);
+            t->heapPos = (uint32_t*)realloc(t->heapPos, sizeof(uint32_t) * t->capacity);
+            t->heap = (LoanHeapEntry*)realloc(t->heap, sizeof(LoanHeapEntry) * t->capacity);
+            if(!t->slots || !t->heapPos || !t->heap) {
+                printf("Out of memory while recording loans!\n");
+                exit(1);
+            }
+        }
+        slot = t->used++;
+    }
+    Loan* loan = &t->slots[slot];
+    size_t len = borrower ? strnlen(borrower, sizeof(loan->borrower) - 1) : 0;
+    loan->book = s->book;
+    loan->older = s->loan;
+    if(len)
+        memcpy(loan->borrower, borrower, len);
+    loan->borrower[len] = 0;
+    loan->issuedAt = issuedAt;
+    loan->dueAt = dueAt;
+    s->loan = slot + 1;
+    t->heap[t->count].dueAt = dueAt;
+    t->heap[t->count].slot = slot;
+    heapUp(t, t->count++);
+}
+
+// Link to the oldest loan of the slot's title issued to `borrower`, or
+// to its oldest loan at all if borrower is NULL or empty. The chain runs
+// newest first, so that is the last match. NULL if there is none.
+static uint32_t* loanLink(LoanTable* t, BookSlot* s, const char* borrower)
+{
+    uint32_t* found = NULL;
+    for(uint32_t* l = &s->loan; *l; l = &t->slots[*l - 1].older) {
+        if(!borrower || !borrower[0] || strncmp(t->slots[*l - 1].borrower, borrower, 49) == 0)
+            found = l;
+    }
+    return found;
+}
+
+// Close the loan `link` points to. Caller holds the stripe lock.
+static void loanUnlink(LoanTable* t, uint32_t* link)
+{
+    uint32_t slot = *link - 1;
+    uint32_t pos = t->heapPos[slot];
+    *link = t->slots[slot].older;
+    if(pos != --t->count) {
+        uint32_t moved = t->heap[t->count].slot;
+        heapSet(t, pos, t->heap[t->count]);
+        heapUp(t, pos);
+        heapDown(t, t->heapPos[moved]);
+    }
+    t->slots[slot].book = NULL;
+    t->heapPos[slot] = t->freeSlot;
+    t->freeSlot = slot + 1;
+}
+
+// Close the loan a return of one copy by `borrower` ends (see loanLink).
+// Returns 0 if there is no such loan.
+static int loanClose(LoanTable* t, BookSlot* s, const char* borrower)
+{
+    uint32_t* link = loanLink(t, s, borrower);
+    if(!link)
+        return 0;
+    loanUnlink(t, link);
+    return 1;
+}
+
+// Hand the newest loan of `from` to `to`, for an issued copy changing
+// title record. Both records have the same ID, so the same stripe.
+static void loanTransfer(LoanTable* t, BookSlot* from, BookSlot* to)
+{
+    if(!from->loan)
+        return;
+    Loan* loan = &t->slots[from->loan - 1];
+    uint32_t slot = from->loan;
+    from->loan = loan->older;
+    loan->older = to->loan;
+    loan->book = to->book;
+    to->loan = slot;
+}
+
+// Hand all loans of `from` to `to`, for a whole title merging into
+// another record of the same ID. They stay newer than to's own loans.
+static void loanTransferAll(LoanTable* t, BookSlot* from, BookSlot* to)
+{
+    uint32_t l = from->loan;
+    if(!l)
+        return;
+    for(;;) {
+        Loan* loan = &t->slots[l - 1];
+        loan->book = to->book;
+        if(!loan->older) {
+            loan->older = to->loan;
+            break;
+        }
+        l = loan->older;
+    }
+    to->loan = from->loan;
+    from->loan = 0;
+}
+
+// Visit every loan of the table due before `now`, in no particular order.
+// Only heap entries that are due and their direct children are looked at.
+// Returns 0 if `visit` asked to stop.
+static int loansDue(const LoanTable* t, time_t now, int (*visit)(const Loan*, void*), void* ctx, size_t* found)
+{
+    uint32_t* stack;
+    size_t top = 0;
+    int more = 1;
+    if(!t->count || t->heap[0].dueAt >= now)
+        return 1;
+    stack = (uint32_t*)malloc(sizeof(uint32_t) * t->count);
+    if(!stack) {
+        printf("Out of memory while listing loans!\n");
+        exit(1);
+    }
+    stack[top++] = 0;
+    while(top) {
+        uint32_t pos = stack[--top];
+        if(t->heap[pos].dueAt >= now)
+            continue;
+        (*found)++;
+        if(!visit(&t->slots[t->heap[pos].slot], ctx)) {
+            more = 0;
+            break;
+        }
+        for(uint32_t child = 2 * pos + 1; child <= 2 * pos + 2 && child < t->count; child++)
+            stack[top++] = child;
+    }
+    free(stack);
+    return more;
+}
+
+static void loanTableFree(LoanTable* t)
+{
+    free(t->slots);
+    free(t->heapPos);
+    free(t->heap);
+    memset(t, 0, sizeof(*t));
+}
+
+// --- Holds ---
+// Patrons waiting for a book with no copy on the shelf queue up per ID,
+// whichever section the copies are in. A queue is a ring buffer of patron
+// names that doubles when full, so joining it and handing a returned copy
+// to its first patron are O(1). Queues are hashed on ID like the book
+// index, and a return only probes them while someone is waiting at all.
+// Like loans they are kept per stripe, and the caller holds the stripe
+// lock for all of these, so a queue changes together with the loans it
+// turns into.
+
+#define HOLD_MIN_CAPACITY 16
+#define HOLD_RING_MIN 4
+
+typedef struct HoldQueue
+{
+    int id;
+    uint32_t head;          // ring position of the first patron
+    uint32_t count;         // patrons waiting, 0 = empty slot
+    uint32_t capacity;      // ring size, a power of two
+    char (*patrons)[50];
+} HoldQueue;
+
+typedef struct HoldTable
+{
+    HoldQueue* slots;
+    size_t capacity;        // always a power of two
+    size_t count;           // IDs someone is waiting for
+} HoldTable;
+
+static HoldQueue* holdFind(HoldTable* t, int id)
+{
+    if(!t->count)
+        return NULL;
+    size_t mask = t->capacity - 1;
+    for(size_t i = hashId(id) & mask; t->slots[i].count; i = (i + 1) & mask) {
+        if(t->slots[i].id == id)
+            return &t->slots[i];
+    }
+    return NULL;
+}
+
+static void holdGrow(HoldTable* t)
+{
+    size_t newCap = t->capacity ? t->capacity * 2 : HOLD_MIN_CAPACITY;
+    HoldQueue* newSlots = (HoldQueue*)calloc(newCap, sizeof(HoldQueue));
+    if(!newSlots) {
+        printf("Out of memory while queueing holds!\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < t->capacity; i++) {
+        if(!t->slots[i].count)
+            continue;
+        size_t j = hashId(t->slots[i].id) & (newCap - 1);
+        while(newSlots[j].count)
+            j = (j + 1) & (newCap - 1);
+        newSlots[j] = t->slots[i];
+    }
+    free(t->slots);
+    t->slots = newSlots;
+    t->capacity = newCap;
+}
+
+// Add `patron` at the back of the queue for `id`; returns their place,
+// 1 = next in line
+static uint32_t holdPush(HoldTable* t, int id, const char* patron)
+{
+    HoldQueue* q = holdFind(t, id);
+    if(!q) {
+        // keep load factor under 0.7
+        if((t->count + 1) * 10 > t->capacity * 7)
+            holdGrow(t);
+        size_t mask = t->capacity - 1;
+        size_t i = hashId(id) & mask;
+        while(t->slots[i].count)
+            i = (i + 1) & mask;
+        q = &t->slots[i];
+        memset(q, 0, sizeof(*q));
+        q->id = id;
+        t->count++;
+    }
+    if(q->count == q->capacity) {
+        // Unroll the ring into one twice the size
+        uint32_t cap = q->capacity ? q->capacity * 2 : HOLD_RING_MIN;
+        char (*ring)[50] = (char (*)[50])malloc(sizeof(*ring) * cap);
+        if(!ring) {
+            printf("Out of memory while queueing holds!\n");
+            exit(1);
+        }
+        for(uint32_t k = 0; k < q->count; k++)
+            memcpy(ring[k], q->patrons[(q->head + k) & (q->capacity - 1)], sizeof(*ring));
+        free(q->patrons);
+        q->patrons = ring;
+        q->head = 0;
+        q->capacity = cap;
+    }
+    char* name = q->patrons[(q->head + q->count) & (q->capacity - 1)];
+    size_t len = strnlen(patron, 49);
+    memcpy(name, patron, len);
+    name[len] = 0;
+    return ++q->count;
+}
+
+// Place of `patron` in the queue, 0 = first, or -1 if not waiting
+static int holdIndex(const HoldQueue* q, const char* patron)
+{
+    for(uint32_t k = 0; k < q->count; k++) {
+        if(strncmp(q->patrons[(q->head + k) & (q->capacity - 1)], patron, 49) == 0)
+            return (int)k;
+    }
+    return -1;
+}
+
+// Take a queue out of the table with all its patrons. Backward-shift
+// delete, as in the book index.
+static void holdDrop(HoldTable* t, HoldQueue* q)
+{
+    free(q->patrons);
+    size_t tableMask = t->capacity - 1;
+    size_t hole = (size_t)(q - t->slots);
+    size_t i = hole;
+    for(;;) {
+        i = (i + 1) & tableMask;
+        if(!t->slots[i].count)
+            break;
+        size_t home = hashId(t->slots[i].id) & tableMask;
+        if(((i - home) & tableMask) >= ((i - hole) & tableMask)) {
+            t->slots[hole] = t->slots[i];
+            hole = i;
+        }
+    }
+    t->slots[hole].count = 0;
+    t->slots[hole].patrons = NULL;
+    t->count--;
+}
+
+// Drop the patron at place `k`. Taking the first is O(1); otherwise the
+// patrons behind move up one. An emptied queue leaves the table.
+static void holdRemove(HoldTable* t, HoldQueue* q, uint32_t k)
+{
+    uint32_t mask = q->capacity - 1;
+    if(k == 0) {
+        q->head = (q->head + 1) & mask;
+    } else {
+        for(; k + 1 < q->count; k++)
+            memcpy(q->patrons[(q->head + k) & mask], q->patrons[(q->head + k + 1) & mask], sizeof(*q->patrons));
+    }
+    if(!--q->count)
+        holdDrop(t, q);
+}
+
+static void holdTableFree(HoldTable* t)
+{
+    for(size_t i = 0; i < t->capacity; i++)
+        free(t->slots[i].patrons);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+// --- Loan stripes ---
+// Loans and holds are split into stripes on the ID's hash, each with its
+// own mutex, tables and cache line, so issues and returns of different
+// titles never wait on each other. All copies of an ID share a stripe,
+// whichever section they are in, so one lock covers a title's shelf
+// count, loans and queue. The stripe is picked by the top bits of the
+// hash, since the tables inside use the low ones.
+
+#define LOAN_STRIPE_BITS 6
+#define LOAN_STRIPES (1 << LOAN_STRIPE_BITS)
+
+typedef struct LoanStripe
+{
+    pthread_mutex_t lock;
+    LoanTable loans;
+    HoldTable holds;
+} __attribute__((aligned(64))) LoanStripe;
+
+static LoanStripe loanStripes[LOAN_STRIPES] = {
+    [0 ... LOAN_STRIPES - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+
+static LoanStripe* loanStripe(int id)
+{
+    return &loanStripes[(uint32_t)hashId(id) >> (32 - LOAN_STRIPE_BITS)];
+}
+
+size_t overdueLoans(time_t now, int (*visit)(const Loan*, void*), void* ctx)
+{
+    size_t found = 0;
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    for(int i = 0; i < LOAN_STRIPES; i++) {
+        pthread_mutex_lock(&loanStripes[i].lock);
+        int more = loansDue(&loanStripes[i].loans, now, visit, ctx, &found);
+        pthread_mutex_unlock(&loanStripes[i].lock);
+        if(!more)
+            break;
+    }
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    return found;
+}
+
+// Open loans across all stripes. Caller holds catalogLock for writing.
+static uint32_t loanCount(void)
+{
+    uint32_t n = 0;
+    for(int i = 0; i < LOAN_STRIPES; i++)
+        n += loanStripes[i].loans.count;
+    return n;
+}
+
+static void freeLoans(void)
+{
+    for(int i = 0; i < LOAN_STRIPES; i++)
+        loanTableFree(&loanStripes[i].loans);
+}
+
+static void freeHolds(void)
+{
+    for(int i = 0; i < LOAN_STRIPES; i++)
+        holdTableFree(&loanStripes[i].holds);
+}
+
+// --- Write-Ahead Log ---
+// Every catalog mutation is appended as a checksummed record:
+//   uint32 payload length | uint32 crc32 | uint64 lsn | uint8 op | payload
+// payload = int32 a | int32 b | three length-prefixed strings.
+// Records are buffered and written + fsync'd as one group once syncEvery
+// records are pending or syncMs has passed since the oldest of them.
+// walLock only covers copying a record into the buffer. The thread that
+// fills a group swaps in the spare buffer and does the write and fsync
+// under walSyncLock, so other desks keep appending meanwhile and groups
+// still reach the file in log order. With a positive syncMs a timer
+// thread writes out a group whose oldest record has waited that long, so
+// the bound holds even when no further record comes along.
+
+enum {
+    WAL_ADD_SECTION = 1,  // s1 = name
+    WAL_DELETE_SECTION,   // s1 = name
+    WAL_ADD_BOOK,         // a = id, s1 = section, s2 = title, s3 = author
+    WAL_DELETE_BOOK,      // a = id, s1 = section
+    WAL_ISSUE,            // a = id, s1 = section, s2 = borrower,
+                          // s3 = "issued due" in epoch seconds
+    WAL_RETURN,           // a = id, b = 1, s1 = section, s2 = borrower
+                          // (empty = oldest loan); when handed to a hold
+                          // also s3 = "issued due". b = 0: older logs,
+                          // s2 = the patron it was handed to
+    WAL_MOVE,             // a = id, s1 = from, s2 = to
+    WAL_SORT,             // a = criteria, b = ascending, s1 = section
+    WAL_HOLD,             // a = id, s1 = patron
+    WAL_CANCEL_HOLD,      // a = id, s1 = patron
+    WAL_ORDER_SECTION,    // s1 = section
+    WAL_DROP_HOLDS,       // a = id; its last copy left the catalog
+    WAL_MOVE_TITLE        // a = id, s1 = from, s2 = to; every copy
+};
+
+#define WAL_HEADER_SIZE 17
+#define WAL_MAX_PAYLOAD 160
+#define WAL_BUF_SIZE (1 << 20)
+
+typedef struct Wal
+{
+    int fd;                 // -1 = logging off
+    uint64_t lsn;           // last record written or covered by the snapshot
+    char* buf;              // records being appended, under walLock
+    char* spare;            // group being written, under walSyncLock
+    size_t used;
+    int pending;            // records buffered since the last commit
+    int syncEvery;
+    int syncMs;
+    struct timespec oldest; // when the oldest pending record was buffered
+} Wal;
+
+static Wal wal = { -1, 0, NULL, NULL, 0, 0, 64, 100, { 0, 0 } };
+static pthread_mutex_t walSyncLock = PTHREAD_MUTEX_INITIALIZER;
+static int walReplaying;              // holds are served by the logged issues
+static pthread_cond_t walTimerCond;   // with walLock: a group started or closing
+static pthread_t walTimer;
+static int walTimerOn;                // under walLock
+
+static uint32_t crc32(const void* data, size_t len)
+{
+    static uint32_t table[256];
+    if(!table[1]) {
+        for(uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t crc = 0xFFFFFFFFU;
+    while(len--)
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static long msSince(struct timespec t)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t.tv_sec) * 1000L + (now.tv_nsec - t.tv_nsec) / 1000000L;
+}
+
+// Write out every buffered record and fsync them as one group.
+// Appends go on into the other buffer while this waits for the disk.
+static void walFlush(void)
+{
+    pthread_mutex_lock(&walSyncLock);
+    pthread_mutex_lock(&walLock);
+    char* group = wal.buf;
+    size_t used = wal.used;
+    int pending = wal.pending;
+    wal.buf = wal.spare;
+    wal.spare = group;
+    wal.used = 0;
+    wal.pending = 0;
+    pthread_mutex_unlock(&walLock);
+    if(pending) {
+        size_t off = 0;
+        while(off < used) {
+            ssize_t n = write(wal.fd, group + off, used - off);
+            if(n <= 0) {
+                perror("write-ahead log");
+                exit(1);
+            }
+            off += (size_t)n;
+        }
+        fdatasync(wal.fd);
+    }
+    pthread_mutex_unlock(&walSyncLock);
+}
+
+static void walCommit(void)
+{
+    if(wal.fd >= 0)
+        walFlush();
+}
+
+static size_t walPutStr(char* p, const char* str)
+{
+    size_t len = str ? strlen(str) : 0;
+    if(len > 49)
+        len = 49;
+    p[0] = (char)len;
+    memcpy(p + 1, str, len);
+    return len + 1;
+}
+
+// Buffer one record; caller holds walLock and has made room for it.
+// Returns 1 once the group is due to be written.
+static int walAppend(int op, int a, int b, const char* s1, const char* s2, const char* s3)
+{
+    char* rec = wal.buf + wal.used;
+    char* p = rec + WAL_HEADER_SIZE;
+    int32_t ints[2] = { a, b };
+    memcpy(p, ints, sizeof(ints));
+    p += sizeof(ints);
+    p += walPutStr(p, s1);
+    p += walPutStr(p, s2);
+    p += walPutStr(p, s3);
+
+    uint32_t len = (uint32_t)(p - rec - WAL_HEADER_SIZE);
+    uint64_t lsn = ++wal.lsn;
+    memcpy(rec, &len, 4);
+    memcpy(rec + 8, &lsn, 8);
+    rec[16] = (char)op;
+    uint32_t crc = crc32(rec + 8, 9 + len);
+    memcpy(rec + 4, &crc, 4);
+    wal.used += WAL_HEADER_SIZE + len;
+
+    if(wal.pending++ == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &wal.oldest);
+        if(walTimerOn)
+            pthread_cond_signal(&walTimerCond);
+    }
+    return wal.pending >= wal.syncEvery || (wal.syncMs >= 0 && msSince(wal.oldest) >= wal.syncMs);
+}
+
+static void walLog(int op, int a, int b, const char* s1, const char* s2, const char* s3)
+{
+    if(wal.fd < 0)
+        return;
+    pthread_mutex_lock(&walLock);
+    while(wal.used + WAL_HEADER_SIZE + WAL_MAX_PAYLOAD > WAL_BUF_SIZE) {
+        pthread_mutex_unlock(&walLock);
+        walFlush();
+        pthread_mutex_lock(&walLock);
+    }
+    int due = walAppend(op, a, b, s1, s2, s3);
+    pthread_mutex_unlock(&walLock);
+    if(due)
+        walFlush();
+}
+
+// Sleeps until the oldest pending record is syncMs old, then writes the
+// group unless an append or commit got there first
+static void* walTimerLoop(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&walLock);
+    while(walTimerOn) {
+        if(!wal.pending) {
+            pthread_cond_wait(&walTimerCond, &walLock);
+            continue;
+        }
+        struct timespec due = wal.oldest, now;
+        due.tv_sec += wal.syncMs / 1000;
+        due.tv_nsec += (wal.syncMs % 1000) * 1000000L;
+        if(due.tv_nsec >= 1000000000L) {
+            due.tv_sec++;
+            due.tv_nsec -= 1000000000L;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(now.tv_sec < due.tv_sec || (now.tv_sec == due.tv_sec && now.tv_nsec < due.tv_nsec)) {
+            pthread_cond_timedwait(&walTimerCond, &walLock, &due);
+            continue;
+        }
+        pthread_mutex_unlock(&walLock);
+        walFlush();
+        pthread_mutex_lock(&walLock);
+    }
+    pthread_mutex_unlock(&walLock);
+    return NULL;
+}
+
+int walOpen(const char* path)
+{
+    wal.fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(wal.fd < 0)
+        return 0;
+    wal.buf = (char*)malloc(WAL_BUF_SIZE);
+    wal.spare = (char*)malloc(WAL_BUF_SIZE);
+    if(!wal.buf || !wal.spare) {
+        printf("Out of memory while opening the log!\n");
+        exit(1);
+    }
+    wal.used = 0;
+    wal.pending = 0;
+    if(wal.syncMs > 0) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&walTimerCond, &attr);
+        pthread_condattr_destroy(&attr);
+        walTimerOn = 1;
+        if(pthread_create(&walTimer, NULL, walTimerLoop, NULL) != 0) {
+            walTimerOn = 0;
+            pthread_cond_destroy(&walTimerCond);
+        }
+    }
+    return 1;
+}
+
+static void walClose(void)
+{
+    if(wal.fd < 0)
+        return;
+    if(walTimerOn) {
+        pthread_mutex_lock(&walLock);
+        walTimerOn = 0;
+        pthread_cond_signal(&walTimerCond);
+        pthread_mutex_unlock(&walLock);
+        pthread_join(walTimer, NULL);
+        pthread_cond_destroy(&walTimerCond);
+    }
+    walCommit();
+    close(wal.fd);
+    wal.fd = -1;
+    free(wal.buf);
+    free(wal.spare);
+    wal.buf = NULL;
+    wal.spare = NULL;
+}
+
+// A snapshot now covers every logged record, so the log can start over
+static void walCheckpoint(void)
+{
+    if(wal.fd < 0)
+        return;
+    pthread_mutex_lock(&walSyncLock);
+    pthread_mutex_lock(&walLock);
+    wal.used = 0;
+    wal.pending = 0;
+    if(ftruncate(wal.fd, 0) == 0)
+        fsync(wal.fd);
+    pthread_mutex_unlock(&walLock);
+    pthread_mutex_unlock(&walSyncLock);
+}
+
+static const char* walGetStr(const unsigned char** p, const unsigned char* end, char out[50])
+{
+    if(*p >= end || *p + 1 + **p > end)
+        return NULL;
+    size_t len = **p;
+    memcpy(out, *p + 1, len);
+    out[len] = 0;
+    *p += 1 + len;
+    return out;
+}
+
+// Apply logged records newer than the loaded snapshot. A torn or corrupt
+// tail (crash mid-write) ends replay and is cut off the file.
+static int setIssued(Section* sec, int id, int issue, const char* borrower, time_t issuedAt, time_t dueAt);
+static void dropHolds(int id);
+
+Section* replayWal(Section* head, const char* path)
+{
+    int fd = open(path, O_RDWR);
+    if(fd < 0)
+        return head;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return head;
+    }
+    size_t size = (size_t)st.st_size;
+    const unsigned char* map = (const unsigned char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+        close(fd);
+        return head;
+    }
+
+    size_t off = 0;
+    long applied = 0;
+    walReplaying = 1;
+    while(off + WAL_HEADER_SIZE <= size) {
+        const unsigned char* rec = map + off;
+        uint32_t len, crc;
+        uint64_t lsn;
+        memcpy(&len, rec, 4);
+        memcpy(&crc, rec + 4, 4);
+        memcpy(&lsn, rec + 8, 8);
+        if(len < 8 || len > WAL_MAX_PAYLOAD || off + WAL_HEADER_SIZE + len > size ||
+           crc32(rec + 8, 9 + len) != crc)
+            break;
+
+        const unsigned char* p = rec + WAL_HEADER_SIZE;
+        const unsigned char* end = p + len;
+        int32_t ints[2];
+        char s1[50], s2[50], s3[50];
+        memcpy(ints, p, sizeof(ints));
+        p += sizeof(ints);
+        if(!walGetStr(&p, end, s1) || !walGetStr(&p, end, s2) || !walGetStr(&p, end, s3))
+            break;
+        off += WAL_HEADER_SIZE + len;
+        if(lsn <= wal.lsn)
+            continue; // already in the snapshot
+        wal.lsn = lsn;
+        applied++;
+
+        Section* sec = findSection(head, s1);
+        switch(rec[16]) {
+            case WAL_ADD_SECTION:    head = addSection(head, s1); break;
+            case WAL_DELETE_SECTION: head = deleteSection(head, s1); break;
+            case WAL_ADD_BOOK:       if(sec) addBook(sec, ints[0], s2, s3); break;
+            case WAL_DELETE_BOOK:    if(sec) deleteBook(sec, ints[0]); break;
+            case WAL_ISSUE: {
+                long long issuedAt, dueAt;
+                if(sec && sscanf(s3, "%lld %lld", &issuedAt, &dueAt) == 2)
+                    setIssued(sec, ints[0], 1, s2, (time_t)issuedAt, (time_t)dueAt);
+                else if(sec)
+                    issueBook(sec, ints[0]);
+                break;
+            }
+            case WAL_RETURN: {
+                long long issuedAt, dueAt;
+                const char* borrower = ints[1] ? s2 : NULL;
+                if(sec && sscanf(s3, "%lld %lld", &issuedAt, &dueAt) == 2)
+                    setIssued(sec, ints[0], 0, borrower, (time_t)issuedAt, (time_t)dueAt);
+                else if(sec)
+                    returnBookFrom(sec, ints[0], borrower);
+                break;
+            }
+            case WAL_MOVE: {
+                Section* dest = findSection(head, s2);
+                if(sec && dest)
+                    moveBookBetween(sec, dest, ints[0]);
+                break;
+            }
+            case WAL_SORT:           if(sec) sortBooks(sec, ints[0], ints[1]); break;
+            case WAL_HOLD:           reserveBook(ints[0], s1); break;
+            case WAL_CANCEL_HOLD:    cancelHold(ints[0], s1); break;
+            case WAL_ORDER_SECTION:  if(sec) orderSection(sec); break;
+            case WAL_DROP_HOLDS:     dropHolds(ints[0]); break;
+            case WAL_MOVE_TITLE: {
+                Section* dest = findSection(head, s2);
+                if(sec && dest)
+                    moveBooks(sec, dest, &ints[0], 1);
+                break;
+            }
+        }
+    }
+    walReplaying = 0;
+
+    munmap((void*)map, size);
+    if(off < size) {
+        fprintf(stderr, "Write-ahead log '%s': dropping %zu bytes of torn tail\n", path, size - off);
+        if(ftruncate(fd, (off_t)off) == 0)
+            fsync(fd);
+    }
+    close(fd);
+    if(applied)
+        fprintf(stderr, "Replayed %ld logged operations from '%s'\n", applied, path);
+    return head;
+}
+
+// --- Function Implementations ---
+
+// Caller holds catalogLock for writing
+static Section* newSection(const char* name)
+{
+    if(!sectionArena.objSize)
+        arenaInit(&sectionArena, sizeof(Section));
+    Section* newSec = (Section*)arenaAlloc(&sectionArena);
+    strcpy(newSec->name, name);
+    newSec->nameLen = strlen(newSec->name);
+    newSec->hash = hashName(newSec->name, newSec->nameLen);
+    newSec->books = NULL;
+    arenaInit(&newSec->arena, sizeof(Book));
+    newSec->ids = NULL;
+    newSec->bits = NULL;
+    newSec->stock = NULL;
+    newSec->nodes = NULL;
+    newSec->count = newSec->capacity = 0;
+    newSec->copyCount = 0;
+    newSec->issued = 0;
+    newSec->skip = NULL;
+    pthread_rwlock_init(&newSec->lock, NULL);
+    stats.sections++;
+    newSec->older = NULL;
+    newSec->prev = NULL;
+    newSec->next = sectionList;
+    if(sectionList)
+        sectionList->prev = newSec;
+    sectionList = newSec;
+    dirInsert(newSec);
+    walLog(WAL_ADD_SECTION, 0, 0, newSec->name, NULL, NULL);
+    return newSec;
+}
+
+// Caller holds catalogLock
+static Section* sectionNamed(const char* name)
+{
+    size_t len = strlen(name);
+    SectionSlot* slot = dirFind(name, len, hashName(name, len));
+    return slot ? slot->section : NULL;
+}
+
+// The log and the server name sections by their names, so a name is
+// only given once: returns NULL if a section already has it.
+Section* addSection(Section* head, char name[]) 
+{
+    (void)head;
+    pthread_rwlock_wrlock(&catalogLock);
+    Section* newSec = sectionNamed(name) ? NULL : newSection(name);
+    pthread_rwlock_unlock(&catalogLock);
+    return newSec;
+}
+
+// `head` is kept for API compatibility; lookups go through the directory.
+// The result stays valid until someone deletes that section.
+Section* findSection(Section* head, char name[]) 
+{
+    (void)head;
+    pthread_rwlock_rdlock(&catalogLock);
+    Section* sec = sectionNamed(name);
+    pthread_rwlock_unlock(&catalogLock);
+    return sec;
+}
+
+void displaySections(Section* head) 
+{
+    (void)head;
+    pthread_rwlock_rdlock(&catalogLock);
+    Section* temp = sectionList;
+    if(!temp)
+        printf("No sections found.\n");
+    else
+        printf("Library Sections:\n");
+    while(temp) {
+        pthread_rwlock_rdlock(&temp->lock);
+        printf("- %s (%d books, %d issued)\n", temp->name, temp->copyCount,
+               __atomic_load_n(&temp->issued, __ATOMIC_RELAXED));
+        pthread_rwlock_unlock(&temp->lock);
+        temp = temp->next;
+    }
+    pthread_rwlock_unlock(&catalogLock);
+}
+
+LibraryStats libraryStats(void)
+{
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    LibraryStats copy = { stats.sections, stats.books, __atomic_load_n(&stats.issued, __ATOMIC_RELAXED) };
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    return copy;
+}
+
+// Counters for one section, or the whole library when sec is NULL
+void displayStats(Section* sec)
+{
+    if(sec) {
+        pthread_rwlock_rdlock(&sec->lock);
+        printf("Section %s: %d books (%d titles), %d issued, %d available\n",
+               sec->name, sec->copyCount, sec->count, __atomic_load_n(&sec->issued, __ATOMIC_RELAXED),
+               countAvailable(sec));
+        pthread_rwlock_unlock(&sec->lock);
+        return;
+    }
+    LibraryStats now = libraryStats();
+    printf("Library: %ld sections, %ld books, %ld issued, %ld available\n",
+           now.sections, now.books, now.issued, now.books - now.issued);
+}
+
+// "Available"/"Issued" for a single copy, "2/5 available" for several
+static const char* copyStatus(const Section* sec, int col, char buf[32])
+{
+    if(columnCopies(sec, col) == 1)
+        return columnAvailable(sec, col) ? "Available" : "Issued";
+    snprintf(buf, 32, "%d/%d available", columnOnShelf(sec, col), columnCopies(sec, col));
+    return buf;
+}
+
+// Runs with indexLock held
+static int printMatch(Book* b, void* ctx)
+{
+    BookSlot* s = indexSlotOf(b);
+    char status[32];
+    (*(long*)ctx)++;
+    printf("ID:%d | %s by %s | %s | %s\n", b->id, b->title, b->author,
+           copyStatus(s->section, s->col, status), s->section->name);
+    return 1;
+}
+
+void displayPrefixMatches(int field, const char* prefix)
+{
+    long found = 0;
+    searchPrefix(field, prefix, printMatch, &found);
+    if(!found)
+        printf("No books found.\n");
+}
+
+// Every book matching all words of the query, with the lookup time
+void displayKeywordMatches(const char* query)
+{
+    struct timespec start, end;
+    char words[MAX_TOKENS][50];
+    int nWords = tokenize(query, words, 0);
+    int* ids;
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t n = keywordIds(query, &ids);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    long found = 0;
+    for(size_t i = 0; i < n; i++) {
+        size_t mask = bookIndex.capacity - 1;
+        for(size_t j = hashId(ids[i]) & mask; bookIndex.slots[j].book; j = (j + 1) & mask) {
+            // another record of the ID may have supplied some of the words
+            if(bookIndex.slots[j].id == ids[i] && bookHasWords(bookIndex.slots[j].book, words, nWords))
+                printMatch(bookIndex.slots[j].book, &found);
+        }
+    }
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    free(ids);
+    printf("%ld books match (%zu IDs, %.3f ms)\n", found, n,
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+}
+
+typedef struct MatchList
+{
+    Book** books;
+    size_t count;
+    size_t capacity;
+} MatchList;
+
+static int collectMatch(Book* b, void* ctx)
+{
+    MatchList* list = (MatchList*)ctx;
+    if(list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->books = (Book**)realloc(list->books, sizeof(Book*) * list->capacity);
+        if(!list->books) {
+            printf("Out of memory while listing matches!\n");
+            exit(1);
+        }
+    }
+    list->books[list->count++] = b;
+    return 1;
+}
+
+// Substring search; matches are collected first so the reported scan
+// rate doesn't include printing
+void displaySubstringMatches(const char* needle)
+{
+    MatchList list = { NULL, 0, 0 };
+    struct timespec start, end;
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t bytes = scanText(needle, collectMatch, &list);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    long found = 0;
+    for(size_t i = 0; i < list.count; i++)
+        printMatch(list.books[i], &found);
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    free(list.books);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%ld books match (%.1f MB scanned in %.3f ms, %.2f GB/s, %s kernel)\n",
+           found, bytes / 1e6, secs * 1e3, secs > 0 ? bytes / secs / 1e9 : 0.0,
+           scanKernelName ? scanKernelName : "no");
+}
+
+typedef struct LoanList
+{
+    Loan* loans;
+    size_t count;
+    size_t capacity;
+} LoanList;
+
+static int collectLoan(const Loan* loan, void* ctx)
+{
+    LoanList* list = (LoanList*)ctx;
+    if(list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->loans = (Loan*)realloc(list->loans, sizeof(Loan) * list->capacity);
+        if(!list->loans) {
+            printf("Out of memory while listing loans!\n");
+            exit(1);
+        }
+    }
+    list->loans[list->count++] = *loan;
+    return 1;
+}
+
+static int compareDue(const void* a, const void* b)
+{
+    time_t x = ((const Loan*)a)->dueAt, y = ((const Loan*)b)->dueAt;
+    return (x > y) - (x < y);
+}
+
+// Loans due before `now`, longest overdue first. They are copied out of
+// their stripes, so printing holds no stripe lock; indexLock keeps the
+// books they point at alive.
+void displayOverdue(time_t now)
+{
+    LoanList list = { NULL, 0, 0 };
+    size_t found = 0;
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    for(int i = 0; i < LOAN_STRIPES; i++) {
+        pthread_mutex_lock(&loanStripes[i].lock);
+        loansDue(&loanStripes[i].loans, now, collectLoan, &list, &found);
+        pthread_mutex_unlock(&loanStripes[i].lock);
+    }
+    if(list.count)
+        qsort(list.loans, list.count, sizeof(Loan), compareDue);
+    for(size_t i = 0; i < list.count; i++) {
+        const Loan* loan = &list.loans[i];
+        BookSlot* s = indexSlotOf(loan->book);
+        char due[16];
+        struct tm tm;
+        strftime(due, sizeof(due), "%Y-%m-%d", localtime_r(&loan->dueAt, &tm));
+        printf("ID:%d | %s | borrowed by %s | due %s, %ld days overdue | %s\n",
+               loan->book->id, loan->book->title, loan->borrower[0] ? loan->borrower : "(unknown)",
+               due, (long)((now - loan->dueAt) / 86400), s->section->name);
+    }
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    if(!list.count)
+        printf("No overdue loans.\n");
+    free(list.loans);
+}
+
+// Add `copies` copies to the section's record for `id`, or create the
+// record with the given title and author if the section has none.
+// Caller holds the section and indexLock for writing. Returns the
+// title's record.
+static Book* addCopies(Section* sec, int id, const char* title, const char* author, int copies, int onShelf)
+{
+    BookSlot* s = indexFind(sec, id, -1);
+    Book* book;
+    if(s) {
+        book = s->book;
+        columnSetStock(sec, book->col, columnCopies(sec, book->col) + copies,
+                       columnOnShelf(sec, book->col) + onShelf);
+    } else {
+        book = bookAlloc(sec);
+        book->id = id;
+        strcpy(book->title, title);
+        strcpy(book->author, author);
+        columnsAppend(sec, book, copies, onShelf);
+        indexInsert(book, sec);
+        idTreeInsert(book, sec);
+        indexText(book);
+        linkBook(sec, book);
+    }
+    sec->copyCount += copies;
+    stats.books += copies;
+    if(copies > onShelf) {
+        sec->issued += copies - onShelf;
+        __atomic_add_fetch(&stats.issued, copies - onShelf, __ATOMIC_RELAXED);
+    }
+    return book;
+}
+
+static void serveHolds(int id);
+
+// An ID names one title: adding it again to the same section adds a copy
+// and keeps the first title and author. The new copy goes to the first
+// patron waiting for the ID, if any.
+// Caller holds catalogLock for reading, which keeps `sec` alive
+static void addBookTo(Section* sec, int id, const char* title, const char* author)
+{
+    pthread_rwlock_wrlock(&sec->lock);
+    pthread_rwlock_wrlock(&indexLock);
+    addCopies(sec, id, title, author, 1, 1);
+    walLog(WAL_ADD_BOOK, id, 0, sec->name, title, author);
+    serveHolds(id);
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&sec->lock);
+}
+
+void addBook(Section* sec, int id, char title[], char author[]) 
+{
+    pthread_rwlock_rdlock(&catalogLock);
+    addBookTo(sec, id, title, author);
+    pthread_rwlock_unlock(&catalogLock);
+}
+
+void displayBooks(Section* sec) 
+{
+    pthread_rwlock_rdlock(&sec->lock);
+    Book* temp = sec->books;
+    if(!temp)
+        printf("No books in section %s.\n", sec->name);
+    else
+        printf("Books in section %s:\n", sec->name);
+    while(temp) {
+        char status[32];
+        printf("ID:%d | %s by %s | %s\n", temp->id, temp->title, temp->author, copyStatus(sec, temp->col, status));
+        temp = temp->next;
+    }
+    pthread_rwlock_unlock(&sec->lock);
+}
+
+// Walks the bitset and only touches Book nodes that are actually printed
+void displayAvailableBooks(Section* sec)
+{
+    int found = 0;
+    pthread_rwlock_rdlock(&sec->lock);
+    for(int w = 0; w < (sec->count + 63) / 64; w++) {
+        uint64_t bits = __atomic_load_n(&sec->bits[w].available, __ATOMIC_RELAXED);
+        while(bits) {
+            int col = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            Book* b = sec->nodes[col];
+            if(!found++)
+                printf("Available books in section %s:\n", sec->name);
+            if(columnCopies(sec, col) > 1)
+                printf("ID:%d | %s by %s | %d/%d available\n", b->id, b->title, b->author,
+                       columnOnShelf(sec, col), columnCopies(sec, col));
+            else
+                printf("ID:%d | %s by %s\n", b->id, b->title, b->author);
+        }
+    }
+    if(!found)
+        printf("No available books in section %s.\n", sec->name);
+    pthread_rwlock_unlock(&sec->lock);
+}
+
+// Section of some copy of `id` (in `sec` if given) whose issued state is
+// `issued` (-1 = any). Only a hint: the caller locks that section and
+// checks again, since the book may change before then.
+static Section* sectionHolding(Section* sec, int id, int issued)
+{
+    pthread_rwlock_rdlock(&indexLock);
+    BookSlot* s = indexFind(sec, id, issued);
+    Section* found = s ? s->section : NULL;
+    pthread_rwlock_unlock(&indexLock);
+    return found;
+}
+
+// Take one copy of the slot's title off the shelf on a loan to
+// `borrower`. Caller holds indexLock for reading and the ID's stripe `st`.
+// Returns 0 if no copy was on the shelf.
+static int lendCopy(LoanStripe* st, BookSlot* s, const char* borrower, time_t issuedAt, time_t dueAt)
+{
+    if(!columnClaim(s->section, s->col, 1))
+        return 0;
+    __atomic_add_fetch(&s->section->issued, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.issued, 1, __ATOMIC_RELAXED);
+    loanOpen(&st->loans, s, borrower, issuedAt, dueAt);
+    if(wal.fd >= 0) {
+        char times[50];
+        snprintf(times, sizeof(times), "%lld %lld", (long long)issuedAt, (long long)dueAt);
+        walLog(WAL_ISSUE, s->id, 0, s->section->name, borrower, times);
+    }
+    return 1;
+}
+
+// Bring back one issued copy of the slot's title, closing the loan of
+// `borrower` (see loanLink). While patrons hold the ID it goes straight
+// to the first of them on a loan from issuedAt to dueAt, and never shows
+// as available. Returns 2 if it was handed on, 1 if it went back on the
+// shelf, 0 if no copy was out or none was out to borrower. Same locking
+// as lendCopy.
+static int shelveCopy(LoanStripe* st, BookSlot* s, const char* borrower, time_t issuedAt, time_t dueAt)
+{
+    HoldQueue* q = holdFind(&st->holds, s->id);
+    uint32_t* link = loanLink(&st->loans, s, borrower);
+    if((borrower && borrower[0] && !link) || !columnHas(s->section, s->col, 1) ||
+       (!q && !columnClaim(s->section, s->col, 0)))
+        return 0;
+    if(link)
+        loanUnlink(&st->loans, link);
+    if(q) {
+        char patron[50], times[50];
+        memcpy(patron, q->patrons[q->head], sizeof(patron));
+        holdRemove(&st->holds, q, 0);
+        loanOpen(&st->loans, s, patron, issuedAt, dueAt);
+        if(wal.fd >= 0) {
+            snprintf(times, sizeof(times), "%lld %lld", (long long)issuedAt, (long long)dueAt);
+            walLog(WAL_RETURN, s->id, 1, s->section->name, borrower, times);
+        }
+        return 2;
+    }
+    __atomic_sub_fetch(&s->section->issued, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats.issued, 1, __ATOMIC_RELAXED);
+    walLog(WAL_RETURN, s->id, 1, s->section->name, borrower, NULL);
+    return 1;
+}
+
+// Shared by issueBook and returnBook: move one copy of `id` off or back
+// onto the shelf and open or close a loan for it. Each title keeps its
+// on-shelf count, so this costs one index probe per section holding the
+// ID however many copies there are. The copy is claimed with a
+// compare-and-swap on the title's column; its loan and log record follow
+// under the ID's loan stripe, so the log orders them the same way as the
+// catalog while other titles go through other stripes. borrower is only
+// used when issuing; while patrons hold the ID only the first of them
+// can be issued a copy, and leaves the queue with it. When returning,
+// borrower names whose loan to close (NULL or empty = the oldest).
+// issuedAt/dueAt also
+// date the loan of a patron a returned copy is handed to. Returns 0 if no
+// copy was in the right state or the borrower is not next in line, else
+// as shelveCopy.
+static int setIssued(Section* sec, int id, int issue, const char* borrower, time_t issuedAt, time_t dueAt)
+{
+    int done = 0;
+    LoanStripe* st = loanStripe(id);
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    pthread_mutex_lock(&st->lock);
+    HoldQueue* q = issue ? holdFind(&st->holds, id) : NULL;
+    int next = q && borrower && strncmp(q->patrons[q->head], borrower, 49) == 0;
+    if(q && !next && !walReplaying) {
+        // someone else is next in line; a logged issue was allowed then
+    } else if(bookIndex.count) {
+        size_t mask = bookIndex.capacity - 1;
+        for(size_t i = hashId(id) & mask; bookIndex.slots[i].book; i = (i + 1) & mask) {
+            BookSlot* s = &bookIndex.slots[i];
+            if(s->id != id || (sec && s->section != sec))
+                continue;
+            done = issue ? lendCopy(st, s, borrower, issuedAt, dueAt) : shelveCopy(st, s, borrower, issuedAt, dueAt);
+            if(done)
+                break;
+        }
+        if(done && next)
+            holdRemove(&st->holds, q, 0);
+    }
+    pthread_mutex_unlock(&st->lock);
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    return done;
+}
+
+// Issue with an anonymous loan of the default length
+int issueBook(Section* sec, int id) 
+{
+    time_t now = time(NULL);
+    return setIssued(sec, id, 1, "", now, now + LOAN_DAYS * 86400);
+}
+
+int issueBookTo(Section* sec, int id, const char* borrower, time_t dueAt)
+{
+    return setIssued(sec, id, 1, borrower, time(NULL), dueAt);
+}
+
+// Returns 2 when the copy went to the next patron on hold instead of the
+// shelf, so the desk knows to keep it aside
+int returnBook(Section* sec, int id) 
+{
+    return returnBookFrom(sec, id, NULL);
+}
+
+// Return the copy lent to `borrower`; fails if they have none out
+int returnBookFrom(Section* sec, int id, const char* borrower)
+{
+    time_t now = time(NULL);
+    return setIssued(sec, id, 0, borrower, now, now + LOAN_DAYS * 86400);
+}
+
+// Issue a copy of `id` to `patron` if one is on the shelf and nobody else
+// is waiting for it, otherwise queue the patron for the next copy
+// returned or added. Returns 0 if it was issued now, the patron's place
+// in the queue (1 = next) if queued, and -1 if there is no such book or
+// no patron. A patron already queued keeps their place; the first one
+// leaves the queue when they get a copy.
+int reserveBook(int id, const char* patron)
+{
+    int place = -1;
+    if(!patron || !patron[0])
+        return -1;
+    time_t now = time(NULL);
+    LoanStripe* st = loanStripe(id);
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    pthread_mutex_lock(&st->lock);
+    BookSlot* s = indexFind(NULL, id, 0);
+    HoldQueue* q = holdFind(&st->holds, id);
+    int k = q ? holdIndex(q, patron) : -1;
+    if(s && (!q || k == 0) && lendCopy(st, s, patron, now, now + LOAN_DAYS * 86400)) {
+        // replaying the issue takes the patron off the queue again
+        if(q)
+            holdRemove(&st->holds, q, 0);
+        place = 0;
+    } else if(k >= 0) {
+        place = k + 1;
+    } else if(indexFind(NULL, id, -1)) {
+        place = (int)holdPush(&st->holds, id, patron);
+        walLog(WAL_HOLD, id, 0, patron, NULL, NULL);
+    }
+    pthread_mutex_unlock(&st->lock);
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    return place;
+}
+
+// Place of `patron` in the queue for `id` (1 = next), 0 if not waiting
+int holdPosition(int id, const char* patron)
+{
+    LoanStripe* st = loanStripe(id);
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_mutex_lock(&st->lock);
+    HoldQueue* q = holdFind(&st->holds, id);
+    int k = q ? holdIndex(q, patron) : -1;
+    pthread_mutex_unlock(&st->lock);
+    pthread_rwlock_unlock(&catalogLock);
+    return k + 1;
+}
+
+int cancelHold(int id, const char* patron)
+{
+    LoanStripe* st = loanStripe(id);
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_mutex_lock(&st->lock);
+    HoldQueue* q = holdFind(&st->holds, id);
+    int k = q ? holdIndex(q, patron) : -1;
+    if(k >= 0) {
+        holdRemove(&st->holds, q, (uint32_t)k);
+        walLog(WAL_CANCEL_HOLD, id, 0, patron, NULL, NULL);
+    }
+    pthread_mutex_unlock(&st->lock);
+    pthread_rwlock_unlock(&catalogLock);
+    return k >= 0;
+}
+
+// Hand copies of `id` on the shelf to the patrons waiting for it, first
+// come first served, on loans of the default length. Each is logged as an
+// issue to the patron, which replays with the same dates, so replay
+// itself serves nobody. Caller holds catalogLock and indexLock.
+static void serveHolds(int id)
+{
+    LoanStripe* st = loanStripe(id);
+    HoldQueue* q;
+    BookSlot* s;
+    if(walReplaying)
+        return;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&st->lock);
+    while((q = holdFind(&st->holds, id)) && (s = indexFind(NULL, id, 0))) {
+        char patron[50];
+        memcpy(patron, q->patrons[q->head], sizeof(patron));
+        if(!lendCopy(st, s, patron, now, now + LOAN_DAYS * 86400))
+            break;
+        holdRemove(&st->holds, q, 0);
+    }
+    pthread_mutex_unlock(&st->lock);
+}
+
+// Serve every queue, after copies reached the shelf in bulk. Caller holds
+// catalogLock for writing, so the queues only change here.
+static void serveAllHolds(void)
+{
+    for(int i = 0; i < LOAN_STRIPES; i++) {
+        HoldTable* t = &loanStripes[i].holds;
+        size_t n = 0;
+        int* ids;
+        if(!t->count)
+            continue;
+        ids = (int*)malloc(sizeof(int) * t->count);
+        if(!ids) {
+            printf("Out of memory while serving holds!\n");
+            exit(1);
+        }
+        for(size_t j = 0; j < t->capacity; j++) {
+            if(t->slots[j].count)
+                ids[n++] = t->slots[j].id;
+        }
+        for(size_t j = 0; j < n; j++)
+            serveHolds(ids[j]);
+        free(ids);
+    }
+}
+
+// The last copy of `id` left the catalog, so its queue can never be
+// served: drop it and log that. Caller holds indexLock for writing.
+static void dropHolds(int id)
+{
+    LoanStripe* st = loanStripe(id);
+    pthread_mutex_lock(&st->lock);
+    HoldQueue* q = holdFind(&st->holds, id);
+    if(q) {
+        holdDrop(&st->holds, q);
+        walLog(WAL_DROP_HOLDS, id, 0, NULL, NULL, NULL);
+    }
+    pthread_mutex_unlock(&st->lock);
+}
+
+// Remove one copy of `id`, an issued one (closing the title's oldest
+// loan, as an anonymous return would) only if none is on the shelf. The title's record goes with its last copy, and the
+// ID's hold queue with the last copy in the catalog.
+// Caller holds catalogLock for reading
+static int deleteFrom(Section* sec, int id)
+{
+    pthread_rwlock_wrlock(&sec->lock);
+    pthread_rwlock_wrlock(&indexLock);
+    BookSlot* s = indexFind(sec, id, -1);
+    if(!s) {
+        pthread_rwlock_unlock(&indexLock);
+        pthread_rwlock_unlock(&sec->lock);
+        return 0;
+    }
+    Book* book = s->book;
+    int col = book->col;
+    int copies = columnCopies(sec, col);
+    int shelf = columnOnShelf(sec, col);
+    if(!shelf) {
+        sec->issued--;
+        __atomic_sub_fetch(&stats.issued, 1, __ATOMIC_RELAXED);
+        LoanStripe* st = loanStripe(id);
+        pthread_mutex_lock(&st->lock);
+        loanClose(&st->loans, s, NULL);
+        pthread_mutex_unlock(&st->lock);
+    }
+    sec->copyCount--;
+    stats.books--;
+    walLog(WAL_DELETE_BOOK, id, 0, sec->name, NULL, NULL);
+    if(copies > 1) {
+        columnSetStock(sec, col, copies - 1, shelf ? shelf - 1 : 0);
+        pthread_rwlock_unlock(&indexLock);
+    } else {
+        indexRemove(book);
+        idTreeRemove(book);
+        unindexText(book);
+        columnsRemove(sec, col);
+        if(!indexFind(NULL, id, -1))
+            dropHolds(id);
+        pthread_rwlock_unlock(&indexLock);
+        unlinkBook(sec, book);
+        bookFree(sec, book);
+    }
+    pthread_rwlock_unlock(&sec->lock);
+    return 1;
+}
+
+int deleteBook(Section* sec, int id) 
+{
+    pthread_rwlock_rdlock(&catalogLock);
+    int ok = deleteFrom(sec, id);
+    pthread_rwlock_unlock(&catalogLock);
+    return ok;
+}
+
+// --- ID-only desk operations (no section needed) ---
+int issueBookById(int id)
+{
+    return issueBook(NULL, id);
+}
+
+int returnBookById(int id)
+{
+    return returnBook(NULL, id);
+}
+
+int deleteBookById(int id)
+{
+    int done = 0;
+    Section* target;
+    pthread_rwlock_rdlock(&catalogLock);
+    while(!done && (target = sectionHolding(NULL, id, -1)))
+        done = deleteFrom(target, id);
+    pthread_rwlock_unlock(&catalogLock);
+    return done;
+}
+
+// Delete the section called `name` with all its books. Returns 0 if
+// there is none. Caller holds catalogLock for writing, which excludes
+// every other catalog user.
+static int removeSection(const char* name)
+{
+    Section* temp = sectionNamed(name);
+    if(!temp)
+        return 0;
+    walLog(WAL_DELETE_SECTION, 0, 0, temp->name, NULL, NULL);
+
+    // Books allocated in this section's arena go with it in one release;
+    // only books moved in from elsewhere are freed individually. Holding
+    // catalogLock for writing keeps every loan stripe still. IDs left
+    // with no copy anywhere lose their hold queues.
+    size_t waiting = 0;
+    for(int i = 0; i < LOAN_STRIPES; i++)
+        waiting += loanStripes[i].holds.count;
+    Book* b = temp->books;
+    while(b) {
+        Book* next = b->next;
+        BookSlot* s = indexSlotOf(b);
+        while(s->loan)
+            loanUnlink(&loanStripe(b->id)->loans, &s->loan);
+        indexRemove(b);
+        if(waiting && !indexFind(NULL, b->id, -1))
+            dropHolds(b->id);
+        idTreeRemove(b);
+        unindexText(b);
+        free(b->tower);
+        if(slabOf(b)->arena != &temp->arena)
+            bookFree(temp, b);
+        b = next;
+    }
+    arenaRelease(&temp->arena);
+    stats.books -= temp->copyCount;
+    stats.issued -= temp->issued;
+    stats.sections--;
+    columnsFree(temp);
+    skipFree(temp);
+    dirRemove(temp);
+    if(temp->prev)
+        temp->prev->next = temp->next;
+    else
+        sectionList = temp->next;
+    if(temp->next)
+        temp->next->prev = temp->prev;
+    pthread_rwlock_destroy(&temp->lock);
+    arenaFree(&sectionArena, temp);
+    return 1;
+}
+
+Section* deleteSection(Section* head, char name[]) 
+{
+    (void)head;
+    pthread_rwlock_wrlock(&catalogLock);
+    removeSection(name);
+    head = sectionList;
+    pthread_rwlock_unlock(&catalogLock);
+    return head;
+}
+
+
+// --- New Feature: Move a Book Between Sections ---
+int moveBook(Section* head) {
+    char fromSec[50], toSec[50];
+    int bookID;
+
+    printf("Enter the name of the section to move book FROM: ");
+    fgets(fromSec, 50, stdin);
+    fromSec[strcspn(fromSec, "\n")] = 0;
+
+    printf("Enter the name of the section to move book TO: ");
+    fgets(toSec, 50, stdin);
+    toSec[strcspn(toSec, "\n")] = 0;
+
+    Section* source = findSection(head, fromSec);
+    Section* dest = findSection(head, toSec);
+
+    if (!source || !dest) {
+        printf("One or both sections not found!\n");
+        return 0;
+    }
+
+    printf("Enter Book ID to move: ");
+    scanf("%d", &bookID);
+    getchar(); // consume newline
+
+    char title[50] = "";
+    pthread_rwlock_rdlock(&indexLock);
+    BookSlot* slot = indexFind(source, bookID, -1);
+    if (slot)
+        strcpy(title, slot->book->title);
+    pthread_rwlock_unlock(&indexLock);
+    if (!slot || !moveBookBetween(source, dest, bookID)) {
+        printf("Book not found in section '%s'.\n", fromSec);
+        return 0;
+    }
+
+    printf("Book '%s' moved from '%s' to '%s' successfully!\n",
+           title, fromSec, toSec);
+    return 1;
+}
+
+// Move one copy of bookID to `dest`, an issued one (with its loan) only
+// if none is on the shelf. A title's only copy takes its record along
+// in O(1); otherwise the copy joins dest's record for the ID, created if
+// needed. Caller holds both sections and indexLock for writing.
+static int moveCopy(Section* source, Section* dest, int bookID) {
+    BookSlot* slot = indexFind(source, bookID, -1);
+    if (!slot)
+        return 0;
+    Book* temp = slot->book;
+    int col = slot->col;
+    int copies = columnCopies(source, col);
+    int shelf = columnOnShelf(source, col);
+
+    if (source != dest && (copies > 1 || indexFind(dest, bookID, -1))) {
+        int issued = shelf == 0;
+        // May grow the index, so both entries are looked up afterwards
+        Book* joined = addCopies(dest, bookID, temp->title, temp->author, 1, !issued);
+        if (issued) {
+            source->issued--;
+            __atomic_sub_fetch(&stats.issued, 1, __ATOMIC_RELAXED);
+            LoanStripe* st = loanStripe(bookID);
+            pthread_mutex_lock(&st->lock);
+            loanTransfer(&st->loans, indexSlotOf(temp), indexSlotOf(joined));
+            pthread_mutex_unlock(&st->lock);
+        }
+        source->copyCount--;
+        stats.books--;
+        if (copies > 1) {
+            columnSetStock(source, col, copies - 1, issued ? shelf : shelf - 1);
+        } else {
+            indexRemove(temp);
+            idTreeRemove(temp);
+            unindexText(temp);
+            columnsRemove(source, col);
+            unlinkBook(source, temp);
+            bookFree(source, temp);
+        }
+        walLog(WAL_MOVE, bookID, 0, source->name, dest->name, NULL);
+        if (!issued)
+            serveHolds(bookID);
+        return 1;
+    }
+
+    // Detach the record from source section
+    columnsRemove(source, col);
+    unlinkBook(source, temp);
+    bookMoved(temp, source, dest);
+    slot->col = columnsAppend(dest, temp, copies, shelf);
+    source->copyCount -= copies;
+    dest->copyCount += copies;
+    source->issued -= copies - shelf;
+    dest->issued += copies - shelf;
+    slot->section = dest;
+    idTreeMove(temp, dest);
+
+    // Add to destination section
+    linkBook(dest, temp);
+    walLog(WAL_MOVE, bookID, 0, source->name, dest->name, NULL);
+    if (shelf)
+        serveHolds(bookID);
+    return 1;
+}
+
+// Both sections are locked in address order, so opposite moves between
+// the same pair can't deadlock. Caller holds catalogLock for reading.
+static int moveBookTo(Section* source, Section* dest, int bookID) {
+    lockSectionPair(source, dest);
+    pthread_rwlock_wrlock(&indexLock);
+    int ok = moveCopy(source, dest, bookID);
+    pthread_rwlock_unlock(&indexLock);
+    unlockSectionPair(source, dest);
+    return ok;
+}
+
+// Move without prompting; returns 0 if the book is not in `source`
+int moveBookBetween(Section* source, Section* dest, int bookID) {
+    pthread_rwlock_rdlock(&catalogLock);
+    int ok = moveBookTo(source, dest, bookID);
+    pthread_rwlock_unlock(&catalogLock);
+    return ok;
+}
+
+// Move every copy of bookID to `dest` in one step. Without a record for
+// the ID in dest, the record itself is relinked and keeps its index and
+// text entries; otherwise its counts and loans join dest's record and it
+// is dropped. Logged as one move of the whole title. Returns the copies
+// moved. Caller holds both sections and indexLock for writing.
+static int moveTitle(Section* source, Section* dest, int bookID) {
+    BookSlot* slot = indexFind(source, bookID, -1);
+    if (!slot)
+        return 0;
+    Book* temp = slot->book;
+    int col = slot->col;
+    int copies = columnCopies(source, col);
+    int shelf = columnOnShelf(source, col);
+    BookSlot* into = indexFind(dest, bookID, -1);
+
+    source->copyCount -= copies;
+    source->issued -= copies - shelf;
+    dest->copyCount += copies;
+    dest->issued += copies - shelf;
+    if (into) {
+        Book* joined = into->book;
+        columnSetStock(dest, joined->col, columnCopies(dest, joined->col) + copies,
+                       columnOnShelf(dest, joined->col) + shelf);
+        LoanStripe* st = loanStripe(bookID);
+        pthread_mutex_lock(&st->lock);
+        loanTransferAll(&st->loans, slot, into);
+        pthread_mutex_unlock(&st->lock);
+        indexRemove(temp);
+        idTreeRemove(temp);
+        unindexText(temp);
+        columnsRemove(source, col);
+        unlinkBook(source, temp);
+        bookFree(source, temp);
+    } else {
+        columnsRemove(source, col);
+        unlinkBook(source, temp);
+        bookMoved(temp, source, dest);
+        slot->col = columnsAppend(dest, temp, copies, shelf);
+        slot->section = dest;
+        idTreeMove(temp, dest);
+        linkBook(dest, temp);
+    }
+    walLog(WAL_MOVE_TITLE, bookID, 0, source->name, dest->name, NULL);
+    if (shelf)
+        serveHolds(bookID);
+    return copies;
+}
+
+// Bulk moves lock the pair and the index once for the whole batch and
+// move each title they pick with all its copies in one step, logged as
+// one record. They return how many copies moved.
+size_t moveBooks(Section* source, Section* dest, const int* ids, size_t n) {
+    size_t moved = 0;
+    if (source == dest)
+        return 0;
+    pthread_rwlock_rdlock(&catalogLock);
+    lockSectionPair(source, dest);
+    pthread_rwlock_wrlock(&indexLock);
+    for (size_t i = 0; i < n; i++)
+        moved += (size_t)moveTitle(source, dest, ids[i]);
+    pthread_rwlock_unlock(&indexLock);
+    unlockSectionPair(source, dest);
+    pthread_rwlock_unlock(&catalogLock);
+    return moved;
+}
+
+// One pass over source's list; `match` runs with both sections and the
+// index locked, so it must not call back into the catalog
+size_t moveBooksWhere(Section* source, Section* dest, int (*match)(Book*, void*), void* ctx) {
+    size_t moved = 0;
+    if (source == dest)
+        return 0;
+    pthread_rwlock_rdlock(&catalogLock);
+    lockSectionPair(source, dest);
+    pthread_rwlock_wrlock(&indexLock);
+    Book* next;
+    for (Book* b = source->books; b; b = next) {
+        next = b->next;
+        if (!match(b, ctx))
+            continue;
+        moved += (size_t)moveTitle(source, dest, b->id);
+    }
+    pthread_rwlock_unlock(&indexLock);
+    unlockSectionPair(source, dest);
+    pthread_rwlock_unlock(&catalogLock);
+    return moved;
+}
+
+
+// --- Sorting Function ---
+// Stable merge sort that relinks `next` pointers; book data never moves,
+// so pointers to a Book stay valid across a sort.
+
+// <0 if a should come before b, >0 if after, 0 if equal for this criteria
+static int compareBooks(Book* a, Book* b, int criteria, int ascending) {
+    int cmp = 0;
+
+    if (criteria == 1) // Sort by ID
+        cmp = (a->id > b->id) - (a->id < b->id);
+    else if (criteria == 2) // Sort by Title
+        cmp = strcmp(a->title, b->title);
+    else if (criteria == 3) // Sort by Author
+        cmp = strcmp(a->author, b->author);
+
+    return ascending ? cmp : -cmp;
+}
+
+static Book* mergeBooks(Book* a, Book* b, int criteria, int ascending) {
+    Book* head = NULL;
+    Book** tail = &head;
+
+    while (a && b) {
+        // Take from the left run on ties to keep the sort stable
+        if (compareBooks(a, b, criteria, ascending) <= 0) {
+            *tail = a;
+            a = a->next;
+        } else {
+            *tail = b;
+            b = b->next;
+        }
+        tail = &(*tail)->next;
+    }
+    *tail = a ? a : b;
+    return head;
+}
+
+static Book* mergeSortBooks(Book* head, int criteria, int ascending) {
+    if (!head || !head->next) return head;
+
+    // Split the list in half with slow/fast pointers
+    Book* slow = head;
+    Book* fast = head->next;
+    while (fast && fast->next) {
+        slow = slow->next;
+        fast = fast->next->next;
+    }
+    Book* right = slow->next;
+    slow->next = NULL;
+
+    return mergeBooks(mergeSortBooks(head, criteria, ascending),
+                      mergeSortBooks(right, criteria, ascending),
+                      criteria, ascending);
+}
+
+// Ordered sections always list by ID and are left alone
+void sortBooks(Section* sec, int criteria, int ascending) {
+    if (!sec) return;
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_wrlock(&sec->lock);
+    if (!sec->books || sec->skip) {
+        pthread_rwlock_unlock(&sec->lock);
+        pthread_rwlock_unlock(&catalogLock);
+        return;
+    }
+
+    sec->books = mergeSortBooks(sec->books, criteria, ascending);
+    walLog(WAL_SORT, criteria, ascending, sec->name, NULL, NULL);
+
+    // Merge only maintains `next`; rebuild the back links in one pass
+    Book* prev = NULL;
+    for (Book* b = sec->books; b; b = b->next) {
+        b->prev = prev;
+        prev = b;
+    }
+    pthread_rwlock_unlock(&sec->lock);
+    pthread_rwlock_unlock(&catalogLock);
+}
+
+
+// Caller holds the section for writing
+static void orderBooks(Section* sec) {
+    sec->books = mergeSortBooks(sec->books, 1, 1);
+    Book* prev = NULL;
+    for (Book* b = sec->books; b; b = b->next) {
+        b->prev = prev;
+        prev = b;
+    }
+    skipBuild(sec);
+}
+
+// Keep the section sorted by ID from now on: sort what it holds, then
+// build the skip list over it. Later inserts go to their place.
+void orderSection(Section* sec) {
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_wrlock(&sec->lock);
+    if (!sec->skip) {
+        orderBooks(sec);
+        walLog(WAL_ORDER_SECTION, 0, 0, sec->name, NULL, NULL);
+    }
+    pthread_rwlock_unlock(&sec->lock);
+    pthread_rwlock_unlock(&catalogLock);
+}
+
+// Visit the books of `sec` with IDs from lo to hi. An ordered section
+// seeks to lo through its skip list and stops after hi, visiting in ID
+// order; any other section is scanned whole. Runs with the section
+// locked for reading; returns the number of books visited.
+// Every title of source with an ID in [lo, hi]. An ordered source is
+// entered through its skip list; otherwise its ID column is scanned from
+// the end, since moving a title fills its column from the last one.
+size_t moveBooksInRange(Section* source, Section* dest, int lo, int hi) {
+    size_t moved = 0;
+    if (source == dest)
+        return 0;
+    pthread_rwlock_rdlock(&catalogLock);
+    lockSectionPair(source, dest);
+    pthread_rwlock_wrlock(&indexLock);
+    if (source->skip) {
+        Book* next;
+        for (Book* b = skipSeek(source, lo); b && b->id <= hi; b = next) {
+            next = b->next;
+            moved += (size_t)moveTitle(source, dest, b->id);
+        }
+    } else {
+        for (int col = source->count - 1; col >= 0; col--) {
+            if (source->ids[col] >= lo && source->ids[col] <= hi)
+                moved += (size_t)moveTitle(source, dest, source->ids[col]);
+        }
+    }
+    pthread_rwlock_unlock(&indexLock);
+    unlockSectionPair(source, dest);
+    pthread_rwlock_unlock(&catalogLock);
+    return moved;
+}
+
+size_t booksInRange(Section* sec, int lo, int hi, int (*visit)(Book*, void*), void* ctx) {
+    size_t found = 0;
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&sec->lock);
+    if (sec->skip) {
+        for (Book* b = skipSeek(sec, lo); b && b->id <= hi; b = b->next) {
+            found++;
+            if (!visit(b, ctx))
+                break;
+        }
+    } else {
+        // The ID column is scanned instead of the list, so only the nodes
+        // of books in range are read
+        for (int col = 0; col < sec->count; col++) {
+            if (sec->ids[col] < lo || sec->ids[col] > hi)
+                continue;
+            found++;
+            if (!visit(sec->nodes[col], ctx))
+                break;
+        }
+    }
+    pthread_rwlock_unlock(&sec->lock);
+    pthread_rwlock_unlock(&catalogLock);
+    return found;
+}
+
+// Runs with the book's section locked
+static int printInSection(Book* b, void* ctx) {
+    const Section* sec = (const Section*)ctx;
+    char status[32];
+    printf("ID:%d | %s by %s | %s\n", b->id, b->title, b->author, copyStatus(sec, b->col, status));
+    return 1;
+}
+
+void displayRange(Section* sec, int lo, int hi) {
+    if (!booksInRange(sec, lo, hi, printInSection, sec))
+        printf("No books with IDs %d-%d in section %s.\n", lo, hi, sec->name);
+}
+
+// Every title in the library with an ID in [lo, hi], in ID order, from
+// the catalog ID tree; visit returns 0 to stop early. Returns how many
+// were visited.
+size_t catalogRange(int lo, int hi, int (*visit)(Book*, Section*, void*), void* ctx) {
+    size_t found = 0;
+    pthread_rwlock_rdlock(&catalogLock);
+    pthread_rwlock_rdlock(&indexLock);
+    if (idTree.root && lo <= hi) {
+        BTreeLeaf* leaf = idTreeDescend(lo, NULL, NULL, NULL);
+        int i = leafLowerBound(leaf, lo, NULL);
+        int more = 1;
+        for (; leaf && more; leaf = leaf->next, i = 0) {
+            for (; i < leaf->count && more; i++) {
+                if (leaf->ids[i] > hi)
+                    break;
+                found++;
+                more = visit(leaf->books[i], leaf->sections[i], ctx);
+            }
+            if (i < leaf->count)
+                more = 0;
+        }
+    }
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    return found;
+}
+
+static int printInCatalog(Book* b, Section* sec, void* ctx) {
+    (void)ctx;
+    char status[32];
+    printf("ID:%d | %s by %s | %s | %s\n", b->id, b->title, b->author,
+           copyStatus(sec, b->col, status), sec->name);
+    return 1;
+}
+
+void displayCatalogRange(int lo, int hi) {
+    if (!catalogRange(lo, hi, printInCatalog, NULL))
+        printf("No books with IDs %d-%d in the library.\n", lo, hi);
+}
+
+
+// --- Binary Snapshot ---
+// Layout: header, then one record per section in list order, then every
+// title record grouped by section in list order, then one record per open
+// loan in title order, then one per waiting patron, each queue front to
+// back. Records are fixed size and native-endian, so loading is one
+// sequential pass over the mapping. The mapping is only read, though:
+// every title still becomes a Book node and every index is rebuilt, so
+// load time grows with the catalog. Older files still load: versions 2
+// and 3 have one record per copy, which fold into one record per title;
+// version 2 has no loans and versions before 5 no holds, with the header
+// cut short accordingly.
+
+#define SNAPSHOT_MAGIC "LIBSNAP1"
+#define SNAPSHOT_VERSION 5
+#define SNAPSHOT_V2_HEADER 32
+
+typedef struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t bookCount;
+    uint64_t walLsn;      // last logged operation the snapshot includes
+    uint64_t loanCount;   // version 3 on
+    uint64_t holdCount;   // version 5 on
+} SnapshotHeader;
+
+typedef struct SnapshotSection
+{
+    char name[50];
+    uint16_t flags;       // SNAPSHOT_ORDERED; zero in files from before
+    uint32_t bookCount;
+} SnapshotSection;
+
+#define SNAPSHOT_ORDERED 1  // section kept sorted by ID
+
+typedef struct SnapshotBook
+{
+    int32_t id;
+    int32_t issued;       // copies out
+    int32_t copies;
+    char title[50];
+    char author[50];
+} SnapshotBook;
+
+// Versions 2 and 3: one record per copy
+typedef struct SnapshotCopy
+{
+    int32_t id;
+    int32_t isIssued;
+    char title[50];
+    char author[50];
+} SnapshotCopy;
+
+typedef struct SnapshotLoan
+{
+    uint64_t book;        // position among the title records
+    int64_t issuedAt;
+    int64_t dueAt;
+    char borrower[56];
+} SnapshotLoan;
+
+typedef struct SnapshotHold
+{
+    int32_t id;
+    char patron[60];
+} SnapshotHold;
+
+// fsync the directory holding `path`, so a rename into it survives a
+// crash. Returns 0 if that failed.
+static int syncDirOf(const char* path)
+{
+    char dir[1024];
+    const char* slash = strrchr(path, '/');
+    if(!slash)
+        snprintf(dir, sizeof(dir), ".");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if(fd < 0)
+        return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+static int writeSnapshot(Section* head, const char* path)
+{
+    char tmpPath[1024];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE* fp = fopen(tmpPath, "wb");
+    if(!fp)
+        return 0;
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, 8);
+    hdr.version = SNAPSHOT_VERSION;
+    for(Section* sec = head; sec; sec = sec->next)
+        hdr.sectionCount++;
+    hdr.bookCount = bookIndex.count;
+    hdr.walLsn = wal.lsn;
+    hdr.loanCount = loanCount();
+    for(int i = 0; i < LOAN_STRIPES; i++) {
+        const HoldTable* t = &loanStripes[i].holds;
+        for(size_t j = 0; j < t->capacity; j++)
+            hdr.holdCount += t->slots[j].count;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    for(Section* sec = head; sec; sec = sec->next) {
+        SnapshotSection rec;
+        memset(&rec, 0, sizeof(rec));
+        memcpy(rec.name, sec->name, sec->nameLen);
+        rec.flags = sec->skip ? SNAPSHOT_ORDERED : 0;
+        for(Book* b = sec->books; b; b = b->next)
+            rec.bookCount++;
+        fwrite(&rec, sizeof(rec), 1, fp);
+    }
+    for(Section* sec = head; sec; sec = sec->next) {
+        for(Book* b = sec->books; b; b = b->next) {
+            SnapshotBook rec;
+            memset(&rec, 0, sizeof(rec));
+            rec.id = b->id;
+            rec.copies = columnCopies(sec, b->col);
+            rec.issued = rec.copies - columnOnShelf(sec, b->col);
+            strcpy(rec.title, b->title);
+            strcpy(rec.author, b->author);
+            fwrite(&rec, sizeof(rec), 1, fp);
+        }
+    }
+    // A title's loans are written oldest first, so that reopening them in
+    // file order rebuilds the same chain
+    uint64_t ordinal = 0;
+    uint32_t* chain = NULL;
+    size_t chainCap = 0;
+    for(Section* sec = head; sec; sec = sec->next) {
+        for(Book* b = sec->books; b; b = b->next, ordinal++) {
+            BookSlot* s = columnOnShelf(sec, b->col) == columnCopies(sec, b->col) ? NULL : indexSlotOf(b);
+            const LoanTable* t = &loanStripe(b->id)->loans;
+            size_t n = 0;
+            for(uint32_t l = s ? s->loan : 0; l; l = t->slots[l - 1].older) {
+                if(n == chainCap) {
+                    chainCap = chainCap ? chainCap * 2 : 64;
+                    chain = (uint32_t*)realloc(chain, sizeof(uint32_t) * chainCap);
+                    if(!chain) {
+                        printf("Out of memory while saving loans!\n");
+                        exit(1);
+                    }
+                }
+                chain[n++] = l - 1;
+            }
+            while(n-- > 0) {
+                const Loan* loan = &t->slots[chain[n]];
+                SnapshotLoan rec;
+                memset(&rec, 0, sizeof(rec));
+                rec.book = ordinal;
+                rec.issuedAt = loan->issuedAt;
+                rec.dueAt = loan->dueAt;
+                strcpy(rec.borrower, loan->borrower);
+                fwrite(&rec, sizeof(rec), 1, fp);
+            }
+        }
+    }
+    free(chain);
+    for(int i = 0; i < LOAN_STRIPES; i++) {
+        const HoldTable* t = &loanStripes[i].holds;
+        for(size_t j = 0; j < t->capacity; j++) {
+            const HoldQueue* q = &t->slots[j];
+            for(uint32_t k = 0; k < q->count; k++) {
+                SnapshotHold rec;
+                memset(&rec, 0, sizeof(rec));
+                rec.id = q->id;
+                strcpy(rec.patron, q->patrons[(q->head + k) & (q->capacity - 1)]);
+                fwrite(&rec, sizeof(rec), 1, fp);
+            }
+        }
+    }
+
+    int ok = !ferror(fp);
+    if(fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+        ok = 0;
+    fclose(fp);
+    if(!ok || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+        return 0;
+    }
+    // Only once the rename is on disk may the log go: a crash in between
+    // must not leave the old snapshot next to an empty log
+    if(!syncDirOf(path))
+        return 0;
+    walCheckpoint();
+    return 1;
+}
+
+// Holds the catalog exclusively while writing, so the file is one
+// consistent point in time
+int saveSnapshot(Section* head, const char* path)
+{
+    (void)head;
+    pthread_rwlock_wrlock(&catalogLock);
+    int ok = writeSnapshot(sectionList, path);
+    pthread_rwlock_unlock(&catalogLock);
+    return ok;
+}
+
+// One title record restored by loadSnapshot, kept for the ID-ordered pass
+typedef struct LoadedBook
+{
+    Book* book;
+    Section* sec;
+} LoadedBook;
+
+static int compareLoadedIds(const void* a, const void* b)
+{
+    int x = ((const LoadedBook*)a)->book->id, y = ((const LoadedBook*)b)->book->id;
+    return (x > y) - (x < y);
+}
+
+// Map a snapshot and add its sections in front of `head`.
+// Returns `head` unchanged if the file is missing or malformed.
+// Records are taken in file order and appended to their section's list,
+// which leaves the lists, and each title's loans, as they were saved.
+// The book index and stored text fill in as records arrive; postings and
+// the ID tree are built afterwards in ascending ID order, as importCsv
+// does, so they only ever append, and an empty prefix tree is built in
+// one pass over its sorted keys. Copies
+// from older files fold into their title's record one by one.
+Section* loadSnapshot(Section* head, const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return head;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < SNAPSHOT_V2_HEADER) {
+        close(fd);
+        return head;
+    }
+    size_t size = (size_t)st.st_size;
+    const char* map = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return head;
+    madvise((void*)map, size, MADV_SEQUENTIAL);
+
+    const SnapshotHeader* hdr = (const SnapshotHeader*)map;
+    int perTitle = hdr->version >= 4;
+    int withLoans = hdr->version >= 3 && size >= offsetof(SnapshotHeader, holdCount);
+    int withHolds = hdr->version >= 5 && size >= sizeof(*hdr);
+    size_t hdrSize = withHolds ? sizeof(*hdr) : withLoans ? offsetof(SnapshotHeader, holdCount) : SNAPSHOT_V2_HEADER;
+    size_t recSize = perTitle ? sizeof(SnapshotBook) : sizeof(SnapshotCopy);
+    uint64_t loanCount = withLoans ? hdr->loanCount : 0;
+    uint64_t holdCount = withHolds ? hdr->holdCount : 0;
+    const SnapshotSection* secs = (const SnapshotSection*)(map + hdrSize);
+    const char* books = (const char*)(secs + hdr->sectionCount);
+    const SnapshotLoan* loans = (const SnapshotLoan*)(books + hdr->bookCount * recSize);
+    const SnapshotHold* holds = (const SnapshotHold*)(loans + loanCount);
+    uint64_t total = 0;
+    int valid = memcmp(hdr->magic, SNAPSHOT_MAGIC, 8) == 0 &&
+                hdr->version >= 2 && hdr->version <= SNAPSHOT_VERSION &&
+                hdr->bookCount <= size / recSize &&
+                loanCount <= size / sizeof(SnapshotLoan) &&
+                holdCount <= size / sizeof(SnapshotHold) &&
+                size == hdrSize + hdr->sectionCount * sizeof(SnapshotSection) +
+                        hdr->bookCount * recSize + loanCount * sizeof(SnapshotLoan) +
+                        holdCount * sizeof(SnapshotHold);
+    for(uint32_t i = 0; valid && i < hdr->sectionCount; i++)
+        total += secs[i].bookCount;
+    if(!valid || total != hdr->bookCount) {
+        fprintf(stderr, "Snapshot '%s' is not valid, ignoring it.\n", path);
+        munmap((void*)map, size);
+        return head;
+    }
+    LoadedBook* loaded = (LoadedBook*)malloc(sizeof(LoadedBook) * (hdr->bookCount + 1));
+    if(!loaded) {
+        printf("Out of memory while loading!\n");
+        exit(1);
+    }
+
+    pthread_rwlock_wrlock(&catalogLock);
+    pthread_rwlock_wrlock(&indexLock);
+    indexReserve(hdr->bookCount);
+    wal.lsn = hdr->walLsn;
+
+    // Sections are created last to first, since each goes on the front
+    Section** made = (Section**)malloc(sizeof(Section*) * (hdr->sectionCount + 1));
+    if(!made) {
+        printf("Out of memory while loading!\n");
+        exit(1);
+    }
+    for(uint32_t i = hdr->sectionCount; i-- > 0; ) {
+        char name[50];
+        memcpy(name, secs[i].name, 49);
+        name[49] = 0;
+        made[i] = newSection(name);
+    }
+
+    uint64_t rec = 0;
+    size_t fresh = 0;
+    long copies = 0, issued = 0;
+    const SnapshotLoan* loan = loans;
+    const SnapshotLoan* loanEnd = loans + loanCount;
+    for(uint32_t i = 0; i < hdr->sectionCount; i++) {
+        Section* sec = made[i];
+        Book* tail = NULL;
+        columnsReserve(sec, (int)secs[i].bookCount);
+        for(uint64_t end = rec + secs[i].bookCount; rec < end; rec++) {
+            const char* r = books + rec * recSize;
+            int id, n, out;
+            const char* title;
+            const char* author;
+            if(perTitle) {
+                const SnapshotBook* t = (const SnapshotBook*)r;
+                id = t->id;
+                n = t->copies < 1 ? 1 : t->copies;
+                out = t->issued < 0 ? 0 : t->issued > n ? n : t->issued;
+                title = t->title;
+                author = t->author;
+            } else {
+                const SnapshotCopy* c = (const SnapshotCopy*)r;
+                id = c->id;
+                n = 1;
+                out = c->isIssued != 0;
+                title = c->title;
+                author = c->author;
+            }
+            BookSlot* s = perTitle ? NULL : indexFind(sec, id, -1);
+            Book* b;
+            if(s) {
+                b = s->book;
+                columnSetStock(sec, b->col, columnCopies(sec, b->col) + n,
+                               columnOnShelf(sec, b->col) + n - out);
+            } else {
+                b = bookAlloc(sec);
+                b->id = id;
+                memcpy(b->title, title, 49);
+                b->title[49] = 0;
+                memcpy(b->author, author, 49);
+                b->author[49] = 0;
+                columnsAppend(sec, b, n, n - out);
+                b->tower = NULL;
+                b->next = NULL;
+                b->prev = tail;
+                if(tail)
+                    tail->next = b;
+                else
+                    sec->books = b;
+                tail = b;
+                indexInsert(b, sec);
+                textArenaAdd(b);
+                loaded[fresh].book = b;
+                loaded[fresh++].sec = sec;
+            }
+            sec->copyCount += n;
+            sec->issued += out;
+            copies += n;
+            issued += out;
+
+            // A record's loans are stored oldest first, at most one per
+            // copy out
+            while(loan < loanEnd && loan->book < rec)
+                loan++;
+            if(loan < loanEnd && loan->book == rec) {
+                LoanStripe* ls = loanStripe(id);
+                pthread_mutex_lock(&ls->lock);
+                for(int k = 0; loan < loanEnd && loan->book == rec; loan++) {
+                    if(k++ >= out)
+                        continue;
+                    char borrower[50];
+                    memcpy(borrower, loan->borrower, 49);
+                    borrower[49] = 0;
+                    loanOpen(&ls->loans, indexSlotOf(b), borrower, (time_t)loan->issuedAt, (time_t)loan->dueAt);
+                }
+                pthread_mutex_unlock(&ls->lock);
+            }
+        }
+        if(secs[i].flags & SNAPSHOT_ORDERED)
+            orderBooks(sec);
+    }
+    free(made);
+
+    qsort(loaded, fresh, sizeof(LoadedBook), compareLoadedIds);
+    Book** list = (Book**)malloc(sizeof(Book*) * (fresh + 1));
+    if(!list) {
+        printf("Out of memory while loading!\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < fresh; i++) {
+        list[i] = loaded[i].book;
+        indexKeywords(loaded[i].book);
+        idTreeInsert(loaded[i].book, loaded[i].sec);
+    }
+    prefixBuild(list, fresh, FIELD_TITLE);
+    prefixBuild(list, fresh, FIELD_AUTHOR);
+    free(list);
+    free(loaded);
+    stats.books += copies;
+    __atomic_add_fetch(&stats.issued, issued, __ATOMIC_RELAXED);
+
+    for(uint64_t i = 0; i < holdCount; i++) {
+        char patron[50];
+        LoanStripe* ls = loanStripe(holds[i].id);
+        memcpy(patron, holds[i].patron, 49);
+        patron[49] = 0;
+        pthread_mutex_lock(&ls->lock);
+        holdPush(&ls->holds, holds[i].id, patron);
+        pthread_mutex_unlock(&ls->lock);
+    }
+    // Older snapshots can have copies on the shelf while patrons wait
+    if(holdCount)
+        serveAllHolds();
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+
+    munmap((void*)map, size);
+    return sectionList;
+}
+
+
+// --- CSV Import ---
+// Loads "section,id,title,author,status" rows in bulk. The file is mapped
+// and cut at line boundaries into one chunk per thread; each worker parses
+// its chunk into compact rows that point back into the mapping, so nothing
+// is copied or allocated per row. Rows are then grouped by section and
+// every section's books are carved from its own arena and linked by one
+// worker each. The shared ID and text indexes are filled in a final serial
+// pass in file order, so the result is the same as adding the rows one by
+// one (keyword postings go in ID order instead, their cheap append path).
+// Rows repeating an ID within a section become copies of its first row.
+// Fields may be quoted ("" escapes a quote) but not span lines; an empty
+// status means available.
+
+#define IMPORT_MAX_THREADS 64
+#define IMPORT_MIN_CHUNK (256 * 1024)
+
+enum {
+    ROW_ISSUED = 1,
+    ROW_TITLE_QUOTED = 2,
+    ROW_AUTHOR_QUOTED = 4,
+    ROW_COPY = 8            // another copy of an earlier title record
+};
+
+typedef struct ImportRow
+{
+    union {
+        const char* title;  // raw field in the mapping while parsing
+        Book* book;         // the title's node once phase two is done
+    };
+    const char* author;
+    int id;
+    uint32_t section;       // chunk-local name, then import-wide target
+    uint8_t titleLen;       // raw field lengths, capped at 255
+    uint8_t authorLen;
+    uint8_t flags;
+} ImportRow;
+
+typedef struct ImportChunk
+{
+    const char* start;
+    const char* end;
+    int skipHeader;
+    ImportRow* rows;
+    size_t count;
+    size_t capacity;
+    char (*names)[50];      // section names in order of first appearance
+    uint32_t nameCount;
+    uint32_t nameCapacity;
+    uint32_t* nameSlots;    // open addressing, name number + 1
+    uint32_t slotCapacity;  // always a power of two
+    uint32_t* remap;        // name number -> import target
+    long rejected;
+} ImportChunk;
+
+typedef struct ImportTarget
+{
+    Section* sec;
+    size_t first;           // this section's rows in the grouped order
+    size_t count;
+} ImportTarget;
+
+typedef struct ImportJob
+{
+    ImportTarget* targets;
+    uint32_t targetCount;
+    uint32_t next;          // next target to link, claimed atomically
+    ImportRow** order;
+} ImportJob;
+
+typedef struct CsvField
+{
+    const char* start;
+    size_t len;             // raw bytes, inside the quotes if quoted
+    int quoted;
+} CsvField;
+
+// Split one line into at most n fields. Returns the field count, or -1
+// for an unterminated quote or text after a closing quote.
+static int csvSplit(const char* p, const char* end, CsvField* fields, int n)
+{
+    int count = 0;
+    for(;;) {
+        CsvField f = { p, 0, 0 };
+        if(p < end && *p == '"') {
+            f.quoted = 1;
+            f.start = ++p;
+            while(p < end && (*p != '"' || (p + 1 < end && p[1] == '"')))
+                p += *p == '"' ? 2 : 1;
+            if(p >= end)
+                return -1;
+            f.len = (size_t)(p++ - f.start);
+            if(p < end && *p != ',')
+                return -1;
+        } else {
+            while(p < end && *p != ',')
+                p++;
+            f.len = (size_t)(p - f.start);
+        }
+        if(count < n)
+            fields[count] = f;
+        count++;
+        if(p >= end)
+            return count;
+        p++; // the comma
+    }
+}
+
+// Copy a field into a 50-char record buffer, truncating like fgets would
+static void csvDecode(char out[50], const char* raw, size_t len, int quoted)
+{
+    size_t n = 0;
+    for(size_t i = 0; i < len && n < 49; i++) {
+        out[n++] = raw[i];
+        if(quoted && raw[i] == '"')
+            i++; // skip the second quote of ""
+    }
+    out[n] = 0;
+}
+
+static int csvId(const CsvField* f, int* id)
+{
+    const char* p = f->start;
+    const char* end = p + f->len;
+    int negative = 0;
+    long long v = 0;
+    if(p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if(p == end)
+        return 0;
+    for(; p < end; p++) {
+        if(*p < '0' || *p > '9' || v > 2147483648LL)
+            return 0;
+        v = v * 10 + (*p - '0');
+    }
+    v = negative ? -v : v;
+    if(v < INT32_MIN || v > INT32_MAX)
+        return 0;
+    *id = (int)v;
+    return 1;
+}
+
+// 1 = issued, 0 = available, -1 = not a status
+static int csvStatus(const CsvField* f)
+{
+    static const char* const issued[] = { "issued", "1", "yes", "true", "out" };
+    static const char* const available[] = { "available", "0", "no", "false", "in" };
+    char text[50];
+    if(!f->len)
+        return 0;
+    csvDecode(text, f->start, f->len, f->quoted);
+    for(size_t i = 0; i < sizeof(issued) / sizeof(issued[0]); i++) {
+        if(strcasecmp(text, issued[i]) == 0)
+            return 1;
+        if(strcasecmp(text, available[i]) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+static void chunkGrowNames(ImportChunk* c)
+{
+    uint32_t cap = c->slotCapacity ? c->slotCapacity * 2 : 64;
+    uint32_t* slots = (uint32_t*)calloc(cap, sizeof(uint32_t));
+    if(!slots) {
+        printf("Out of memory while importing!\n");
+        exit(1);
+    }
+    for(uint32_t i = 0; i < c->nameCount; i++) {
+        uint32_t h = hashName(c->names[i], strlen(c->names[i])) & (cap - 1);
+        while(slots[h])
+            h = (h + 1) & (cap - 1);
+        slots[h] = i + 1;
+    }
+    free(c->nameSlots);
+    c->nameSlots = slots;
+    c->slotCapacity = cap;
+}
+
+// Number of a section name within the chunk, added on first sight
+static uint32_t chunkName(ImportChunk* c, const char* name)
+{
+    if((c->nameCount + 1) * 2 > c->slotCapacity)
+        chunkGrowNames(c);
+    size_t len = strlen(name);
+    uint32_t mask = c->slotCapacity - 1;
+    uint32_t h = hashName(name, len) & mask;
+    for(; c->nameSlots[h]; h = (h + 1) & mask) {
+        if(strcmp(c->names[c->nameSlots[h] - 1], name) == 0)
+            return c->nameSlots[h] - 1;
+    }
+    if(c->nameCount == c->nameCapacity) {
+        c->nameCapacity = c->nameCapacity ? c->nameCapacity * 2 : 16;
+        c->names = (char (*)[50])realloc(c->names, sizeof(*c->names) * c->nameCapacity);
+        if(!c->names) {
+            printf("Out of memory while importing!\n");
+            exit(1);
+        }
+    }
+    memcpy(c->names[c->nameCount], name, len + 1);
+    c->nameSlots[h] = c->nameCount + 1;
+    return c->nameCount++;
+}
+
+static void* parseChunk(void* arg)
+{
+    ImportChunk* c = (ImportChunk*)arg;
+    const char* p = c->start;
+    while(p < c->end) {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(c->end - p));
+        const char* lineEnd = nl ? nl : c->end;
+        const char* line = p;
+        p = nl ? nl + 1 : c->end;
+        if(lineEnd > line && lineEnd[-1] == '\r')
+            lineEnd--;
+        if(lineEnd == line)
+            continue;
+
+        CsvField f[5];
+        int n = csvSplit(line, lineEnd, f, 5);
+        int id = 0, status = n == 4 ? 0 : -1;
+        if(n == 5)
+            status = csvStatus(&f[4]);
+        if(n < 4 || n > 5 || !csvId(&f[1], &id) || status < 0 || !f[0].len) {
+            if(!c->skipHeader)
+                c->rejected++;
+            c->skipHeader = 0;
+            continue;
+        }
+        c->skipHeader = 0;
+
+        if(c->count == c->capacity) {
+            c->capacity = c->capacity ? c->capacity * 2 : 4096;
+            c->rows = (ImportRow*)realloc(c->rows, sizeof(ImportRow) * c->capacity);
+            if(!c->rows) {
+                printf("Out of memory while importing!\n");
+                exit(1);
+            }
+        }
+        char name[50];
+        csvDecode(name, f[0].start, f[0].len, f[0].quoted);
+        ImportRow* row = &c->rows[c->count++];
+        row->title = f[2].start;
+        row->author = f[3].start;
+        row->id = id;
+        row->section = chunkName(c, name);
+        row->titleLen = (uint8_t)(f[2].len < 255 ? f[2].len : 255);
+        row->authorLen = (uint8_t)(f[3].len < 255 ? f[3].len : 255);
+        row->flags = (uint8_t)((status ? ROW_ISSUED : 0) |
+                               (f[2].quoted ? ROW_TITLE_QUOTED : 0) |
+                               (f[3].quoted ? ROW_AUTHOR_QUOTED : 0));
+    }
+    return NULL;
+}
+
+// Build each claimed section's new titles as one chain, in file order, and
+// splice it on the front: the same list repeated addBook calls would give.
+// Ordered sections take each new title into their skip list instead.
+// A row whose ID the section already has, from before the import or an
+// earlier row, adds a copy to that record. The book index is only read
+// here; new records are found through a table local to the section.
+static void* linkSections(void* arg)
+{
+    ImportJob* job = (ImportJob*)arg;
+    uint32_t t;
+    while((t = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->targetCount) {
+        ImportTarget* target = &job->targets[t];
+        Section* sec = target->sec;
+        Book* chain = NULL;
+        Book* last = NULL;
+        size_t mask = 1;
+        while(mask < target->count * 2)
+            mask <<= 1;
+        Book** seen = (Book**)calloc(mask--, sizeof(Book*));
+        if(!seen) {
+            printf("Out of memory while importing!\n");
+            exit(1);
+        }
+        columnsReserve(sec, (int)target->count);
+        for(size_t i = 0; i < target->count; i++) {
+            ImportRow* row = job->order[target->first + i];
+            int issued = (row->flags & ROW_ISSUED) != 0;
+            size_t h = hashId(row->id) & mask;
+            while(seen[h] && seen[h]->id != row->id)
+                h = (h + 1) & mask;
+            BookSlot* s = seen[h] ? NULL : indexFind(sec, row->id, -1);
+            Book* b = seen[h] ? seen[h] : s ? s->book : NULL;
+            sec->copyCount++;
+            sec->issued += issued;
+            if(b) {
+                columnSetStock(sec, b->col, columnCopies(sec, b->col) + 1, columnOnShelf(sec, b->col) + !issued);
+                row->flags |= ROW_COPY;
+                row->book = b;
+                continue;
+            }
+            b = bookAlloc(sec);
+            b->id = row->id;
+            csvDecode(b->title, row->title, row->titleLen, row->flags & ROW_TITLE_QUOTED);
+            csvDecode(b->author, row->author, row->authorLen, row->flags & ROW_AUTHOR_QUOTED);
+            columnsAppend(sec, b, 1, !issued);
+            seen[h] = b;
+            row->book = b;
+            if(sec->skip) {
+                skipInsert(sec, b);
+                continue;
+            }
+            b->tower = NULL;
+            b->prev = NULL;
+            b->next = chain;
+            if(chain)
+                chain->prev = b;
+            else
+                last = b;
+            chain = b;
+        }
+        free(seen);
+        if(last) {
+            last->next = sec->books;
+            if(sec->books)
+                sec->books->prev = last;
+            sec->books = chain;
+        }
+    }
+    return NULL;
+}
 
-// --- Function Implementations ---
+// Run `fn` on n threads, the caller being the last, with argument i at
+// args + i * argSize, and wait for all of them
+static void runImportThreads(void* (*fn)(void*), void* args, size_t argSize, int n)
+{
+    pthread_t tid[IMPORT_MAX_THREADS];
+    int started = 0;
+    for(int i = 0; i < n - 1; i++) {
+        if(pthread_create(&tid[started], NULL, fn, (char*)args + argSize * (size_t)i) != 0)
+            fn((char*)args + argSize * (size_t)i); // no thread to spare: do it here
+        else
+            started++;
+    }
+    fn((char*)args + argSize * (size_t)(n - 1));
+    for(int i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+}
 
-Section* addSection(Section* head, char name[]) 
+static int compareRowIds(const void* a, const void* b)
 {
-    Section* newSec = (Section*)malloc(sizeof(Section));
-    strcpy(newSec->name, name);
-    newSec->books = NULL;
-    newSec->next = head;
-    return newSec;
+    int x = (*(ImportRow* const*)a)->id, y = (*(ImportRow* const*)b)->id;
+    return (x > y) - (x < y);
 }
 
-Section* findSection(Section* head, char name[]) 
+static double secondsBetween(struct timespec a, struct timespec b)
 {
-    Section* temp = head;
-    while(temp) {
-        if(strcmp(temp->name, name) == 0)
-            return temp;
-        temp = temp->next;
-    }
-    return NULL;
+    return (double)(b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
 }
 
-void displaySections(Section* head) 
+// Import `path` with up to `threads` workers (0 = one per CPU). Sections
+// are created as needed and the catalog is held exclusively throughout.
+// report->rows is -1 if the file can't be read.
+Section* importCsv(Section* head, const char* path, int threads, ImportReport* report)
 {
-    Section* temp = head;
-    if(!temp) {
-        printf("No sections found.\n");
-        return;
+    (void)head;
+    memset(report, 0, sizeof(*report));
+    report->rows = -1;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return sectionList;
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        return sectionList;
     }
-    printf("Library Sections:\n");
-    while(temp) {
-        printf("- %s\n", temp->name);
-        temp = temp->next;
+    report->rows = 0;
+    size_t size = (size_t)st.st_size;
+    if(!size) {
+        close(fd);
+        return sectionList;
+    }
+    const char* map = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        report->rows = -1;
+        return sectionList;
+    }
+    madvise((void*)map, size, MADV_SEQUENTIAL);
+
+    if(threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads > IMPORT_MAX_THREADS)
+        threads = IMPORT_MAX_THREADS;
+    if((size_t)threads > size / IMPORT_MIN_CHUNK + 1)
+        threads = (int)(size / IMPORT_MIN_CHUNK + 1);
+    if(threads < 1)
+        threads = 1;
+    report->threads = threads;
+
+    // Phase one: parse chunks that start right after a newline
+    struct timespec t0, t1, t2, t3;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ImportChunk* chunks = (ImportChunk*)calloc((size_t)threads, sizeof(ImportChunk));
+    if(!chunks) {
+        printf("Out of memory while importing!\n");
+        exit(1);
+    }
+    const char* cut = map;
+    for(int i = 0; i < threads; i++) {
+        const char* end = map + size / (size_t)threads * (size_t)(i + 1);
+        if(i == threads - 1)
+            end = map + size;
+        else if(end <= cut)
+            end = cut; // the previous chunk already ran past this one
+        else if(end[-1] != '\n') {
+            const char* nl = (const char*)memchr(end, '\n', (size_t)(map + size - end));
+            end = nl ? nl + 1 : map + size;
+        }
+        chunks[i].start = cut;
+        chunks[i].end = end;
+        cut = end;
+    }
+    chunks[0].skipHeader = 1;
+    runImportThreads(parseChunk, chunks, sizeof(ImportChunk), threads);
+
+    // Phase two: resolve names, group rows by section, link in parallel
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    pthread_rwlock_wrlock(&catalogLock);
+    ImportChunk all;
+    memset(&all, 0, sizeof(all));
+    size_t total = 0;
+    for(int i = 0; i < threads; i++) {
+        ImportChunk* c = &chunks[i];
+        c->remap = (uint32_t*)malloc(sizeof(uint32_t) * (c->nameCount + 1));
+        if(!c->remap) {
+            printf("Out of memory while importing!\n");
+            exit(1);
+        }
+        for(uint32_t j = 0; j < c->nameCount; j++)
+            c->remap[j] = chunkName(&all, c->names[j]);
+        total += c->count;
+        report->rejected += c->rejected;
+    }
+
+    ImportJob job;
+    job.targetCount = all.nameCount;
+    job.next = 0;
+    job.targets = (ImportTarget*)calloc(all.nameCount + 1, sizeof(ImportTarget));
+    job.order = (ImportRow**)malloc(sizeof(ImportRow*) * (total + 1));
+    if(!job.targets || !job.order) {
+        printf("Out of memory while importing!\n");
+        exit(1);
+    }
+    for(uint32_t j = 0; j < all.nameCount; j++) {
+        Section* sec = sectionNamed(all.names[j]);
+        job.targets[j].sec = sec ? sec : newSection(all.names[j]);
+    }
+    for(int i = 0; i < threads; i++) {
+        for(size_t r = 0; r < chunks[i].count; r++) {
+            ImportRow* row = &chunks[i].rows[r];
+            row->section = chunks[i].remap[row->section];
+            job.targets[row->section].count++;
+        }
+    }
+    for(uint32_t j = 1; j < all.nameCount; j++)
+        job.targets[j].first = job.targets[j - 1].first + job.targets[j - 1].count;
+    size_t* fill = (size_t*)calloc(all.nameCount + 1, sizeof(size_t));
+    if(!fill) {
+        printf("Out of memory while importing!\n");
+        exit(1);
+    }
+    for(int i = 0; i < threads; i++) {
+        for(size_t r = 0; r < chunks[i].count; r++) {
+            ImportTarget* target = &job.targets[chunks[i].rows[r].section];
+            job.order[target->first + fill[chunks[i].rows[r].section]++] = &chunks[i].rows[r];
+        }
+    }
+    free(fill);
+    int linkers = (uint32_t)threads < all.nameCount ? threads : (int)all.nameCount;
+    if(linkers > 0)
+        runImportThreads(linkSections, &job, 0, linkers); // all share one job
+
+    // Phase three: shared indexes, counters and the log, in file order
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    pthread_rwlock_wrlock(&indexLock);
+    indexReserve(total);
+    long issued = 0;
+    for(int i = 0; i < threads; i++) {
+        for(size_t r = 0; r < chunks[i].count; r++) {
+            ImportRow* row = &chunks[i].rows[r];
+            Section* sec = job.targets[row->section].sec;
+            if(!(row->flags & ROW_COPY)) {
+                indexInsert(row->book, sec);
+                prefixInsert(row->book, FIELD_TITLE);
+                prefixInsert(row->book, FIELD_AUTHOR);
+                textArenaAdd(row->book);
+            }
+            walLog(WAL_ADD_BOOK, row->id, 0, sec->name, row->book->title, row->book->author);
+            if(row->flags & ROW_ISSUED) {
+                walLog(WAL_ISSUE, row->id, 0, sec->name, NULL, NULL);
+                issued++;
+            }
+        }
+    }
+    // Postings and the ID tree append without re-encoding or splitting
+    // halfway when IDs arrive in order
+    size_t k = 0;
+    for(int i = 0; i < threads; i++) {
+        for(size_t r = 0; r < chunks[i].count; r++) {
+            if(!(chunks[i].rows[r].flags & ROW_COPY))
+                job.order[k++] = &chunks[i].rows[r];
+        }
+    }
+    qsort(job.order, k, sizeof(ImportRow*), compareRowIds);
+    for(size_t r = 0; r < k; r++) {
+        indexKeywords(job.order[r]->book);
+        idTreeInsert(job.order[r]->book, job.targets[job.order[r]->section].sec);
+    }
+    stats.books += (long)total;
+    __atomic_add_fetch(&stats.issued, issued, __ATOMIC_RELAXED);
+    serveAllHolds(); // copies that arrived for waiting patrons
+    pthread_rwlock_unlock(&indexLock);
+    pthread_rwlock_unlock(&catalogLock);
+    clock_gettime(CLOCK_MONOTONIC, &t3);
+
+    for(int i = 0; i < threads; i++) {
+        free(chunks[i].rows);
+        free(chunks[i].names);
+        free(chunks[i].nameSlots);
+        free(chunks[i].remap);
     }
+    free(chunks);
+    free(all.names);
+    free(all.nameSlots);
+    free(job.targets);
+    free(job.order);
+    munmap((void*)map, size);
+
+    report->rows = (long)total;
+    report->sections = all.nameCount;
+    report->parseSecs = secondsBetween(t0, t1);
+    report->linkSecs = secondsBetween(t1, t2);
+    report->indexSecs = secondsBetween(t2, t3);
+    return sectionList;
 }
 
-void addBook(Section* sec, int id, char title[], char author[]) 
+void displayImportReport(const ImportReport* r)
 {
-    Book* newBook = (Book*)malloc(sizeof(Book));
-    newBook->id = id;
-    strcpy(newBook->title, title);
-    strcpy(newBook->author, author);
-    newBook->isIssued = 0;
-    newBook->next = sec->books;
-    sec->books = newBook;
+    double secs = r->parseSecs + r->linkSecs + r->indexSecs;
+    printf("Imported %ld books into %ld sections (%ld rows rejected) with %d threads\n",
+           r->rows, r->sections, r->rejected, r->threads);
+    printf("parse %.3f s, link %.3f s, index %.3f s: %.0f rows/s\n",
+           r->parseSecs, r->linkSecs, r->indexSecs, secs > 0 ? r->rows / secs : 0.0);
 }
 
-void displayBooks(Section* sec) 
+// --- Export ---
+// Streams books as CSV (the format importCsv reads) or JSON Lines through
+// one large buffer that goes to write() whole, so a full dump costs one
+// syscall per megabyte instead of a printf per book. Rows follow list
+// order, sections included, as displayBooks shows them.
+
+#define EXPORT_BUF_SIZE (1 << 20)
+#define EXPORT_ROW_MAX 2048  // four fields of 49 chars, each fully escaped
+
+typedef struct ExportBuffer
 {
-    Book* temp = sec->books;
-    if(!temp) {
-        printf("No books in section %s.\n", sec->name);
-        return;
+    int fd;
+    char* buf;
+    size_t used;
+    int failed;
+} ExportBuffer;
+
+static void exportFlush(ExportBuffer* out)
+{
+    size_t done = 0;
+    while(done < out->used && !out->failed) {
+        ssize_t n = write(out->fd, out->buf + done, out->used - done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            out->failed = 1;
+        else
+            done += (size_t)n;
     }
-    printf("Books in section %s:\n", sec->name);
-    while(temp) {
-        printf("ID:%d | %s by %s | %s\n", temp->id, temp->title, temp->author, temp->isIssued ? "Issued" : "Available");
-        temp = temp->next;
+    out->used = 0;
+}
+
+static char* putBytes(char* p, const char* s, size_t n)
+{
+    memcpy(p, s, n);
+    return p + n;
+}
+
+#define putLiteral(p, s) putBytes(p, s, sizeof(s) - 1)
+
+static char* putCsvField(char* p, const char* s)
+{
+    if(!s[strcspn(s, ",\"\r\n")])
+        return putBytes(p, s, strlen(s));
+    *p++ = '"';
+    for(; *s; s++) {
+        if(*s == '"')
+            *p++ = '"';
+        *p++ = *s;
     }
+    *p++ = '"';
+    return p;
 }
 
-int issueBook(Section* sec, int id) 
+static char* putJsonString(char* p, const char* s)
 {
-    Book* temp = sec->books;
-    while(temp) {
-        if(temp->id == id && temp->isIssued == 0) {
-            temp->isIssued = 1;
-            return 1; // success
+    static const char hex[] = "0123456789abcdef";
+    *p++ = '"';
+    for(; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if(c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = (char)c;
+        } else if(c < 0x20) {
+            memcpy(p, "\\u00", 4);
+            p[4] = hex[c >> 4];
+            p[5] = hex[c & 15];
+            p += 6;
+        } else {
+            *p++ = (char)c;
         }
-        temp = temp->next;
     }
-    return 0; // fail
+    *p++ = '"';
+    return p;
 }
 
-int returnBook(Section* sec, int id) 
+static char* putInt(char* p, int v)
 {
-    Book* temp = sec->books;
-    while(temp) {
-        if(temp->id == id && temp->isIssued == 1) {
-            temp->isIssued = 0;
-            return 1; // success
+    char digits[12];
+    int n = 0;
+    unsigned int u = v < 0 ? 0U - (unsigned int)v : (unsigned int)v;
+    do {
+        digits[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while(u);
+    if(v < 0)
+        *p++ = '-';
+    while(n)
+        *p++ = digits[--n];
+    return p;
+}
+
+// One row per copy, the ones on the shelf first, so IMPORT reads the
+// file back into the same records
+static long exportSection(ExportBuffer* out, Section* sec, int json)
+{
+    // The section column is the same on every row, so format it once
+    char name[EXPORT_ROW_MAX / 4];
+    size_t nameLen = (size_t)((json ? putJsonString(name, sec->name) : putCsvField(name, sec->name)) - name);
+    long rows = 0;
+    pthread_rwlock_rdlock(&sec->lock);
+    for(Book* b = sec->books; b; b = b->next) {
+        int copies = columnCopies(sec, b->col);
+        int shelf = columnOnShelf(sec, b->col);
+        for(int copy = 0; copy < copies; copy++) {
+            if(out->used + EXPORT_ROW_MAX > EXPORT_BUF_SIZE)
+                exportFlush(out);
+            char* p = out->buf + out->used;
+            const char* status = copy < shelf ? "available" : "issued";
+            if(json) {
+                p = putLiteral(p, "{\"section\":");
+                p = putBytes(p, name, nameLen);
+                p = putInt(putLiteral(p, ",\"id\":"), b->id);
+                p = putJsonString(putLiteral(p, ",\"title\":"), b->title);
+                p = putJsonString(putLiteral(p, ",\"author\":"), b->author);
+                p = putJsonString(putLiteral(p, ",\"status\":"), status);
+                p = putLiteral(p, "}\n");
+            } else {
+                p = putBytes(p, name, nameLen);
+                p = putInt(putLiteral(p, ","), b->id);
+                p = putCsvField(putLiteral(p, ","), b->title);
+                p = putCsvField(putLiteral(p, ","), b->author);
+                p = putBytes(putLiteral(p, ","), status, strlen(status));
+                p = putLiteral(p, "\n");
+            }
+            out->used = (size_t)(p - out->buf);
+            rows++;
         }
-        temp = temp->next;
     }
-    return 0; // fail
+    pthread_rwlock_unlock(&sec->lock);
+    return rows;
 }
 
-int deleteBook(Section* sec, int id) 
+// Export one section, or every section when sec is NULL, as "csv" or
+// "jsonl" to `path` (NULL or "-" = stdout). Returns the number of books
+// written, or -1 for an unknown format or a failed open/write.
+long exportBooks(Section* sec, const char* format, const char* path)
 {
-    Book* temp = sec->books;
-    Book* prev = NULL;
-    while(temp) {
-        if(temp->id == id) {
-            if(prev)
-                prev->next = temp->next;
-            else
-                sec->books = temp->next;
-            free(temp);
-            return 1;
-        }
-        prev = temp;
-        temp = temp->next;
+    int json = strcmp(format, "jsonl") == 0;
+    if(!json && strcmp(format, "csv") != 0)
+        return -1;
+    ExportBuffer out = { 1, NULL, 0, 0 };
+    if(path && strcmp(path, "-") != 0) {
+        out.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(out.fd < 0)
+            return -1;
+    } else {
+        fflush(stdout); // keep earlier printf output ahead of the dump
     }
-    return 0;
+    out.buf = (char*)malloc(EXPORT_BUF_SIZE);
+    if(!out.buf) {
+        printf("Out of memory while exporting!\n");
+        exit(1);
+    }
+
+    long rows = 0;
+    if(!json)
+        out.used = (size_t)(putLiteral(out.buf, "section,id,title,author,status\n") - out.buf);
+    pthread_rwlock_rdlock(&catalogLock);
+    if(sec)
+        rows = exportSection(&out, sec, json);
+    for(Section* s = sec ? NULL : sectionList; s; s = s->next)
+        rows += exportSection(&out, s, json);
+    pthread_rwlock_unlock(&catalogLock);
+    exportFlush(&out);
+
+    if(out.fd != 1 && close(out.fd) != 0)
+        out.failed = 1;
+    free(out.buf);
+    return out.failed ? -1 : rows;
 }
 
-Section* deleteSection(Section* head, char name[]) 
+// Tear down the whole catalog and every index. Nothing has to stay
+// consistent on the way, so instead of deleting book by book (which
+// updates every index per book) each section's slabs are freed whole
+// and every index is dropped in one piece.
+void freeLibrary(Section* library)
 {
-    Section* temp = head;
-    Section* prev = NULL;
-    while(temp) {
-        if(strcmp(temp->name, name) == 0) {
-            // Free all books in section
-            Book* b = temp->books;
-            while(b) {
-                Book* next = b->next;
-                free(b);
-                b = next;
-            }
-            if(prev)
-                prev->next = temp->next;
-            else
-                head = temp->next;
-            free(temp);
-            return head;
+    (void)library;
+    walClose(); // tearing the catalog down is not a logged mutation
+    pthread_rwlock_wrlock(&catalogLock);
+    // Towers live outside the slabs, and so do books moved in from a
+    // section deleted since, whose slabs only go with their last book
+    for(Section* sec = sectionList; sec; sec = sec->next) {
+        Book* b = sec->books;
+        while(b) {
+            Book* next = b->next;
+            free(b->tower);
+            if(!slabOf(b)->arena)
+                bookFree(sec, b);
+            b = next;
         }
-        prev = temp;
-        temp = temp->next;
     }
-    return head;
+    for(Section* sec = sectionList; sec; sec = sec->next) {
+        arenaDiscard(&sec->arena);
+        columnsFree(sec);
+        skipFree(sec);
+        pthread_rwlock_destroy(&sec->lock);
+    }
+    sectionList = NULL;
+    memset(&stats, 0, sizeof(stats));
+    pthread_rwlock_unlock(&catalogLock);
+    freeBookIndex();
+    freeIdTree();
+    freeSectionDirectory();
+    freePrefixIndex();
+    freeKeywordIndex();
+    freeTextArena();
+    freeLoans();
+    freeHolds();
+    freeSlabPool();
 }
 
 
-// --- New Feature: Move a Book Between Sections ---
-int moveBook(Section* head) {
-    char fromSec[50], toSec[50];
-    int bookID;
+// Everything below is the interactive program; build with
+// -DLIBRARY_NO_MAIN to reuse the catalog code from another program.
+#ifndef LIBRARY_NO_MAIN
 
-    printf("Enter the name of the section to move book FROM: ");
-    fgets(fromSec, 50, stdin);
-    fromSec[strcspn(fromSec, "\n")] = 0;
+// --- Batch Mode ---
+// Runs a script of one command per line, fields separated by '|':
+//   ADD_SECTION|name            DELETE_SECTION|name
+//   ADD_BOOK|section|id|title|author
+//   ISSUE|id   RETURN|id   DELETE|id
+//   ISSUE|id|borrower|days      (loan with a due date)
+//   RETURN|id|borrower          (close that borrower's loan; plain RETURN
+//                               closes the oldest)
+//   OVERDUE  or  OVERDUE|epoch-seconds   (loans due before now/then)
+//   RESERVE|id|patron           (issue now, or join the hold queue)
+//   HOLD_POSITION|id|patron     CANCEL_HOLD|id|patron
+//   MOVE|from|to|id             SORT|section|criteria|ascending
+//   MOVE_IDS|from|to|id,id,...  MOVE_RANGE|from|to|from-id|to-id
+//                               (every copy of those books, one batch)
+//   ORDER|section               (keep the section sorted by ID)
+//   RANGE|section|from-id|to-id (books with IDs in that range)
+//   RANGE|from-id|to-id         (the same across the whole library)
+//   STATS  or  STATS|section    (prints counters to stdout)
+//   SEARCH_TITLE|prefix         SEARCH_AUTHOR|prefix
+//   SEARCH|words                (books containing every word)
+//   SEARCH_TEXT|text            (title or author contains text)
+//   IMPORT|file.csv  or  IMPORT|file.csv|threads   (bulk CSV load)
+//   EXPORT|csv|jsonl  [|section or *  [|file]]      (stdout by default)
+// Blank lines and lines starting with '#' are skipped. No prompts are
+// printed; failures go to stderr with their line number.
 
-    printf("Enter the name of the section to move book TO: ");
-    fgets(toSec, 50, stdin);
-    toSec[strcspn(toSec, "\n")] = 0;
+#define BATCH_MAX_FIELDS 6
+#define BATCH_LINE_MAX 512
 
-    Section* source = findSection(head, fromSec);
-    Section* dest = findSection(head, toSec);
+static int splitFields(char* line, char* fields[])
+{
+    int n = 0;
+    fields[n++] = line;
+    for(char* p = line; *p && n < BATCH_MAX_FIELDS; p++) {
+        if(*p == '|') {
+            *p = 0;
+            fields[n++] = p + 1;
+        }
+    }
+    return n;
+}
 
-    if (!source || !dest) {
-        printf("One or both sections not found!\n");
+// Copy a field into a 50-char record buffer, truncating like fgets would
+static void copyField(char dst[50], const char* src)
+{
+    snprintf(dst, 50, "%s", src);
+}
+
+// Any whole int; out-of-range numbers are refused rather than wrapped
+static int parseId(const char* text, int* id)
+{
+    char* end;
+    errno = 0;
+    long v = strtol(text, &end, 10);
+    if(end == text || *end || errno == ERANGE || v < INT_MIN || v > INT_MAX)
         return 0;
-    }
+    *id = (int)v;
+    return 1;
+}
 
-    printf("Enter Book ID to move: ");
-    scanf("%d", &bookID);
-    getchar(); // consume newline
+static int runBatchCommand(Section** library, char* fields[], int n)
+{
+    char name[50], other[50], title[50], author[50];
+    const char* cmd = fields[0];
+    Section* sec;
+    int id, crit, asc;
 
-    Book* temp = source->books;
-    Book* prev = NULL;
-    while (temp && temp->id != bookID) {
-        prev = temp;
-        temp = temp->next;
+    if(strcmp(cmd, "ADD_SECTION") == 0 && n == 2) {
+        copyField(name, fields[1]);
+        if(!(sec = addSection(*library, name)))
+            return 0;
+        *library = sec;
+        return 1;
     }
-
-    if (!temp) {
-        printf("Book not found in section '%s'.\n", fromSec);
-        return 0;
+    if(strcmp(cmd, "DELETE_SECTION") == 0 && n == 2) {
+        copyField(name, fields[1]);
+        if(!findSection(*library, name))
+            return 0;
+        *library = deleteSection(*library, name);
+        return 1;
+    }
+    if(strcmp(cmd, "ADD_BOOK") == 0 && n == 5) {
+        copyField(name, fields[1]);
+        sec = findSection(*library, name);
+        if(!sec || !parseId(fields[2], &id))
+            return 0;
+        copyField(title, fields[3]);
+        copyField(author, fields[4]);
+        addBook(sec, id, title, author);
+        return 1;
+    }
+    if(strcmp(cmd, "ISSUE") == 0 && n == 2)
+        return parseId(fields[1], &id) && issueBookById(id);
+    if(strcmp(cmd, "ISSUE") == 0 && n == 4) {
+        int days;
+        if(!parseId(fields[1], &id) || !parseId(fields[3], &days) || days < 1)
+            return 0;
+        return issueBookTo(NULL, id, fields[2], time(NULL) + (time_t)days * 86400);
+    }
+    if(strcmp(cmd, "OVERDUE") == 0 && n <= 2) {
+        long long now = time(NULL);
+        if(n == 2) {
+            char* end;
+            now = strtoll(fields[1], &end, 10);
+            if(end == fields[1] || *end)
+                return 0;
+        }
+        displayOverdue((time_t)now);
+        return 1;
+    }
+    if(strcmp(cmd, "RETURN") == 0 && n == 2)
+        return parseId(fields[1], &id) && returnBookById(id);
+    if(strcmp(cmd, "RETURN") == 0 && n == 3)
+        return parseId(fields[1], &id) && fields[2][0] && returnBookFrom(NULL, id, fields[2]);
+    if(strcmp(cmd, "RESERVE") == 0 && n == 3) {
+        int place;
+        if(!parseId(fields[1], &id) || (place = reserveBook(id, fields[2])) < 0)
+            return 0;
+        if(place)
+            printf("ID:%d | %s is number %d on hold\n", id, fields[2], place);
+        else
+            printf("ID:%d | issued to %s\n", id, fields[2]);
+        return 1;
+    }
+    if(strcmp(cmd, "HOLD_POSITION") == 0 && n == 3) {
+        int place;
+        if(!parseId(fields[1], &id))
+            return 0;
+        if((place = holdPosition(id, fields[2])))
+            printf("ID:%d | %s is number %d on hold\n", id, fields[2], place);
+        else
+            printf("ID:%d | %s is not on hold\n", id, fields[2]);
+        return 1;
+    }
+    if(strcmp(cmd, "CANCEL_HOLD") == 0 && n == 3)
+        return parseId(fields[1], &id) && cancelHold(id, fields[2]);
+    if(strcmp(cmd, "DELETE") == 0 && n == 2)
+        return parseId(fields[1], &id) && deleteBookById(id);
+    if(strcmp(cmd, "MOVE") == 0 && n == 4) {
+        copyField(name, fields[1]);
+        copyField(other, fields[2]);
+        Section* source = findSection(*library, name);
+        Section* dest = findSection(*library, other);
+        if(!source || !dest || !parseId(fields[3], &id))
+            return 0;
+        return moveBookBetween(source, dest, id);
+    }
+    if(strcmp(cmd, "MOVE_IDS") == 0 && n == 4) {
+        int ids[BATCH_LINE_MAX / 2];
+        size_t count = 0;
+        copyField(name, fields[1]);
+        copyField(other, fields[2]);
+        Section* source = findSection(*library, name);
+        Section* dest = findSection(*library, other);
+        if(!source || !dest)
+            return 0;
+        for(char* p = fields[3];; p++) {
+            char* comma = strchr(p, ',');
+            if(comma)
+                *comma = 0;
+            if(!parseId(p, &ids[count++]))
+                return 0;
+            if(!comma)
+                break;
+            p = comma;
+        }
+        return moveBooks(source, dest, ids, count) > 0;
+    }
+    if(strcmp(cmd, "MOVE_RANGE") == 0 && n == 5) {
+        int range[2];
+        copyField(name, fields[1]);
+        copyField(other, fields[2]);
+        Section* source = findSection(*library, name);
+        Section* dest = findSection(*library, other);
+        if(!source || !dest || !parseId(fields[3], &range[0]) || !parseId(fields[4], &range[1]))
+            return 0;
+        return moveBooksInRange(source, dest, range[0], range[1]) > 0;
     }
+    if(strcmp(cmd, "SEARCH_TITLE") == 0 && n == 2) {
+        displayPrefixMatches(FIELD_TITLE, fields[1]);
+        return 1;
+    }
+    if(strcmp(cmd, "SEARCH_AUTHOR") == 0 && n == 2) {
+        displayPrefixMatches(FIELD_AUTHOR, fields[1]);
+        return 1;
+    }
+    if(strcmp(cmd, "SEARCH") == 0 && n == 2) {
+        displayKeywordMatches(fields[1]);
+        return 1;
+    }
+    if(strcmp(cmd, "SEARCH_TEXT") == 0 && n == 2) {
+        displaySubstringMatches(fields[1]);
+        return 1;
+    }
+    if(strcmp(cmd, "IMPORT") == 0 && (n == 2 || n == 3)) {
+        ImportReport report;
+        int threads = 0;
+        if(n == 3 && !parseId(fields[2], &threads))
+            return 0;
+        *library = importCsv(*library, fields[1], threads, &report);
+        if(report.rows < 0)
+            return 0;
+        displayImportReport(&report);
+        return 1;
+    }
+    if(strcmp(cmd, "EXPORT") == 0 && n >= 2 && n <= 4) {
+        sec = NULL;
+        if(n >= 3 && strcmp(fields[2], "*") != 0) {
+            copyField(name, fields[2]);
+            if(!(sec = findSection(*library, name)))
+                return 0;
+        }
+        return exportBooks(sec, fields[1], n == 4 ? fields[3] : NULL) >= 0;
+    }
+    if(strcmp(cmd, "STATS") == 0 && n <= 2) {
+        sec = NULL;
+        if(n == 2) {
+            copyField(name, fields[1]);
+            if(!(sec = findSection(*library, name)))
+                return 0;
+        }
+        displayStats(sec);
+        return 1;
+    }
+    if(strcmp(cmd, "ORDER") == 0 && n == 2) {
+        copyField(name, fields[1]);
+        if(!(sec = findSection(*library, name)))
+            return 0;
+        orderSection(sec);
+        return 1;
+    }
+    if(strcmp(cmd, "RANGE") == 0 && n == 4) {
+        int lo, hi;
+        copyField(name, fields[1]);
+        sec = findSection(*library, name);
+        if(!sec || !parseId(fields[2], &lo) || !parseId(fields[3], &hi))
+            return 0;
+        displayRange(sec, lo, hi);
+        return 1;
+    }
+    if(strcmp(cmd, "RANGE") == 0 && n == 3) {
+        int lo, hi;
+        if(!parseId(fields[1], &lo) || !parseId(fields[2], &hi))
+            return 0;
+        displayCatalogRange(lo, hi);
+        return 1;
+    }
+    if(strcmp(cmd, "SORT") == 0 && n == 4) {
+        copyField(name, fields[1]);
+        sec = findSection(*library, name);
+        if(!sec || !parseId(fields[2], &crit) || !parseId(fields[3], &asc))
+            return 0;
+        sortBooks(sec, crit, asc);
+        return 1;
+    }
+    return -1; // unknown command or wrong field count
+}
 
-    // Detach book from source section
-    if (prev)
-        prev->next = temp->next;
-    else
-        source->books = temp->next;
+static double elapsedSeconds(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
 
-    // Add to destination section
-    temp->next = dest->books;
-    dest->books = temp;
+// Returns the number of commands that failed
+static long runBatch(Section** library, FILE* in)
+{
+    static char inBuf[1 << 20], errBuf[1 << 16];
+    char line[BATCH_LINE_MAX];
+    char* fields[BATCH_MAX_FIELDS];
+    long lineNo = 0, ops = 0, failed = 0;
+    struct timespec start;
 
-    printf("Book '%s' moved from '%s' to '%s' successfully!\n",
-           temp->title, fromSec, toSec);
-    return 1;
+    setvbuf(in, inBuf, _IOFBF, sizeof(inBuf));
+    setvbuf(stderr, errBuf, _IOFBF, sizeof(errBuf)); // failures can be frequent
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while(fgets(line, sizeof(line), in)) {
+        lineNo++;
+        if(!strchr(line, '\n') && !feof(in)) {
+            // fgets stopped at the buffer, not a newline: drop the rest of
+            // the line rather than running its tail as another command
+            int c = getc(in);
+            if(c == '\r')
+                c = getc(in);
+            if(c != '\n' && c != EOF) {
+                while((c = getc(in)) != '\n' && c != EOF)
+                    ;
+                fprintf(stderr, "line %ld: longer than %d characters\n",
+                        lineNo, BATCH_LINE_MAX - 1);
+                ops++;
+                failed++;
+                continue;
+            }
+        }
+        line[strcspn(line, "\r\n")] = 0;
+        if(!line[0] || line[0] == '#')
+            continue;
+
+        int n = splitFields(line, fields);
+        int ok = runBatchCommand(library, fields, n);
+        ops++;
+        if(ok < 0) {
+            fprintf(stderr, "line %ld: unknown command '%s'\n", lineNo, fields[0]);
+            failed++;
+        } else if(!ok) {
+            fprintf(stderr, "line %ld: %s failed\n", lineNo, fields[0]);
+            failed++;
+        }
+    }
+
+    double secs = elapsedSeconds(start);
+    fprintf(stderr, "Batch: %ld commands, %ld failed, %.3f s (%.0f ops/s)\n",
+            ops, failed, secs, secs > 0 ? ops / secs : 0.0);
+    fflush(stderr);
+    return failed;
 }
 
 
-int main() {
+
+int main(int argc, char* argv[]) {
     Section* library = NULL;
     int choice;
     char secName[50], title[50], author[50];
     int id;
 
+    // library [--snapshot <file>] [--wal <file>] [--wal-sync <n>]
+    //         [--wal-sync-ms <ms>] [--scan-kernel <name>] [--batch <script|->]
+    const char* snapshotPath = NULL;
+    const char* walPath = NULL;
+    const char* batchPath = NULL;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+            snapshotPath = argv[++i];
+        else if(strcmp(argv[i], "--wal") == 0 && i + 1 < argc)
+            walPath = argv[++i];
+        else if(strcmp(argv[i], "--wal-sync") == 0 && i + 1 < argc)
+            wal.syncEvery = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--wal-sync-ms") == 0 && i + 1 < argc)
+            wal.syncMs = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            batchPath = argv[++i];
+        else if(strcmp(argv[i], "--scan-kernel") == 0 && i + 1 < argc) {
+            if(!selectScanKernel(argv[++i])) {
+                fprintf(stderr, "Scan kernel '%s' is not available on this machine\n", argv[i]);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--snapshot <file>] [--wal <file>] [--wal-sync <n>] "
+                    "[--wal-sync-ms <ms>] [--scan-kernel scalar|sse2|avx2] [--batch <script|->]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(snapshotPath) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        library = loadSnapshot(library, snapshotPath);
+        if(library)
+            fprintf(stderr, "Loaded %ld books (%zu titles) from '%s' in %.1f ms\n",
+                    stats.books, bookIndex.count, snapshotPath, elapsedSeconds(start) * 1000);
+    }
+    if(walPath) {
+        library = replayWal(library, walPath);
+        if(!walOpen(walPath)) {
+            fprintf(stderr, "Cannot open write-ahead log '%s'\n", walPath);
+            freeLibrary(library);
+            return 1;
+        }
+    }
+
+    if(batchPath) {
+        FILE* in = strcmp(batchPath, "-") == 0 ? stdin : fopen(batchPath, "r");
+        if(!in) {
+            fprintf(stderr, "Cannot open batch file '%s'\n", batchPath);
+            freeLibrary(library);
+            return 1;
+        }
+        long failed = runBatch(&library, in);
+        if(in != stdin)
+            fclose(in);
+        if(snapshotPath && !saveSnapshot(library, snapshotPath))
+            fprintf(stderr, "Could not write snapshot '%s'\n", snapshotPath);
+        freeLibrary(library);
+        return failed ? 2 : 0;
+    }
+
     do {
+        walCommit(); // don't leave changes unsynced while waiting for input
         printf("\n--- Library System Menu ---\n");
         printf("1. Add Section\n2. Delete Section\n3. Display Sections\n");
         printf("4. Add Book\n5. Delete Book\n6. Display Books in Section\n");
         printf("7. Issue Book\n8. Return Book\n9. Exit\n10. Move Book Between Sections\n");
+        printf("11. Issue Book by ID\n12. Return Book by ID\n13. Delete Book by ID\n");
+        printf("14. Sort Books in Section\n15. Display Available Books in Section\n");
+        printf("16. Library Statistics\n17. Search Books by Title/Author Prefix\n");
+        printf("18. Keyword Search\n19. Search Title/Author Containing Text\n");
+        printf("20. Import Books from CSV\n21. Export Books (CSV/JSON Lines)\n");
+        printf("22. Overdue Loans\n23. Reserve Book\n24. Hold Queue Position\n");
+        printf("25. Cancel Hold\n26. Keep Section Ordered by ID\n27. Display Books in ID Range\n");
+        printf("28. Move Books in ID Range\n");
         printf("Enter your choice: ");
         scanf("%d", &choice);
         getchar(); // consume newline
@@ -239,8 +6141,8 @@ int main() {
                 printf("Enter Section Name: ");
                 fgets(secName, 50, stdin);
                 secName[strcspn(secName, "\n")] = 0;
-                library = addSection(library, secName);
-                printf("Section added.\n");
+                if(addSection(library, secName)) printf("Section added.\n");
+                else printf("A section with that name already exists.\n");
                 break;
 
             case 2:
@@ -296,7 +6198,10 @@ int main() {
                 sec = findSection(library, secName);
                 if(sec) {
                     printf("Enter Book ID to Issue: "); scanf("%d", &id); getchar();
-                    if(issueBook(sec, id)) printf("Book issued successfully.\n");
+                    printf("Enter Borrower Name: ");
+                    fgets(author, 50, stdin); author[strcspn(author,"\n")]=0;
+                    if(issueBookTo(sec, id, author, time(NULL) + LOAN_DAYS * 86400))
+                        printf("Book issued successfully, due in %d days.\n", LOAN_DAYS);
                     else printf("Book not available or not found.\n");
                 } else printf("Section not found.\n");
                 break;
@@ -307,7 +6212,11 @@ int main() {
                 sec = findSection(library, secName);
                 if(sec) {
                     printf("Enter Book ID to Return: "); scanf("%d", &id); getchar();
-                    if(returnBook(sec, id)) printf("Book returned successfully.\n");
+                    printf("Enter Borrower Name (blank for the oldest loan): ");
+                    fgets(author, 50, stdin); author[strcspn(author,"\n")]=0;
+                    int done = returnBookFrom(sec, id, author);
+                    if(done == 2) printf("Book returned; keep it for the next patron on hold.\n");
+                    else if(done) printf("Book returned successfully.\n");
                     else printf("Book not found or not issued.\n");
                 } else printf("Section not found.\n");
                 break;
@@ -320,6 +6229,192 @@ int main() {
     moveBook(library);
     break;
 
+            case 11:
+                printf("Enter Book ID to Issue: "); scanf("%d", &id); getchar();
+                printf("Enter Borrower Name: ");
+                fgets(author, 50, stdin); author[strcspn(author,"\n")]=0;
+                if(issueBookTo(NULL, id, author, time(NULL) + LOAN_DAYS * 86400))
+                    printf("Book issued successfully, due in %d days.\n", LOAN_DAYS);
+                else printf("Book not available or not found.\n");
+                break;
+
+            case 12:
+                printf("Enter Book ID to Return: "); scanf("%d", &id); getchar();
+                printf("Enter Borrower Name (blank for the oldest loan): ");
+                fgets(author, 50, stdin); author[strcspn(author,"\n")]=0;
+                int done = returnBookFrom(NULL, id, author);
+                if(done == 2) printf("Book returned; keep it for the next patron on hold.\n");
+                else if(done) printf("Book returned successfully.\n");
+                else printf("Book not found or not issued.\n");
+                break;
+
+            case 13:
+                printf("Enter Book ID to Delete: "); scanf("%d", &id); getchar();
+                if(deleteBookById(id)) printf("Book deleted.\n");
+                else printf("Book not found.\n");
+                break;
+
+            case 14:
+                printf("Enter Section Name to Sort: ");
+                fgets(secName, 50, stdin); secName[strcspn(secName,"\n")]=0;
+                sec = findSection(library, secName);
+                if(sec) {
+                    int crit, asc;
+                    printf("Sort by (1-ID, 2-Title, 3-Author): ");
+                    scanf("%d", &crit);
+                    printf("Order (1-Ascending, 0-Descending): ");
+                    scanf("%d", &asc);
+                    getchar(); // consume newline
+                    sortBooks(sec, crit, asc);
+                    printf("Books in section '%s' sorted successfully!\n", sec->name);
+                } else printf("Section not found.\n");
+                break;
+
+            case 15:
+                printf("Enter Section Name: ");
+                fgets(secName, 50, stdin); secName[strcspn(secName,"\n")]=0;
+                sec = findSection(library, secName);
+                if(sec) displayAvailableBooks(sec);
+                else printf("Section not found.\n");
+                break;
+
+            case 16:
+                printf("Enter Section Name (empty for whole library): ");
+                fgets(secName, 50, stdin); secName[strcspn(secName,"\n")]=0;
+                if(!secName[0]) displayStats(NULL);
+                else if((sec = findSection(library, secName))) displayStats(sec);
+                else printf("Section not found.\n");
+                break;
+
+            case 17: {
+                int field;
+                printf("Search by (1-Title, 2-Author): "); scanf("%d", &field); getchar();
+                printf("Enter Prefix: ");
+                fgets(title, 50, stdin); title[strcspn(title,"\n")]=0;
+                displayPrefixMatches(field == 2 ? FIELD_AUTHOR : FIELD_TITLE, title);
+                break;
+            }
+
+            case 18: {
+                char query[200];
+                printf("Enter Keywords: ");
+                fgets(query, sizeof(query), stdin); query[strcspn(query,"\n")]=0;
+                displayKeywordMatches(query);
+                break;
+            }
+
+            case 19:
+                printf("Enter Text: ");
+                fgets(title, 50, stdin); title[strcspn(title,"\n")]=0;
+                displaySubstringMatches(title);
+                break;
+
+            case 20: {
+                char path[256];
+                ImportReport report;
+                printf("Enter CSV File (section,id,title,author,status): ");
+                fgets(path, sizeof(path), stdin); path[strcspn(path,"\n")]=0;
+                library = importCsv(library, path, 0, &report);
+                if(report.rows < 0)
+                    printf("Cannot read '%s'\n", path);
+                else
+                    displayImportReport(&report);
+                break;
+            }
+
+            case 21: {
+                char format[10], path[256];
+                printf("Enter Section Name (empty for all): ");
+                fgets(secName, 50, stdin); secName[strcspn(secName,"\n")]=0;
+                printf("Format (csv/jsonl): ");
+                fgets(format, sizeof(format), stdin); format[strcspn(format,"\n")]=0;
+                printf("Output File (empty for screen): ");
+                fgets(path, sizeof(path), stdin); path[strcspn(path,"\n")]=0;
+                sec = secName[0] ? findSection(library, secName) : NULL;
+                if(secName[0] && !sec) {
+                    printf("Section not found.\n");
+                    break;
+                }
+                long rows = exportBooks(sec, format, path[0] ? path : NULL);
+                if(rows < 0)
+                    printf("Export failed (format must be csv or jsonl).\n");
+                else
+                    printf("%ld books exported.\n", rows);
+                break;
+            }
+
+            case 22:
+                displayOverdue(time(NULL));
+                break;
+
+            case 23: {
+                printf("Enter Book ID to Reserve: "); scanf("%d", &id); getchar();
+                printf("Enter Patron Name: ");
+                fgets(author, 50, stdin); author[strcspn(author,"\n")]=0;
+                int place = reserveBook(id, author);
+                if(place < 0) printf("Book not found.\n");
+                else if(place == 0) printf("Book issued successfully, due in %d days.\n", LOAN_DAYS);
+                else printf("All copies are out; %s is number %d on hold.\n", author, place);
+                break;
+            }
+
+            case 24: {
+                printf("Enter Book ID: "); scanf("%d", &id); getchar();
+                printf("Enter Patron Name: ");
+                fgets(author, 50, stdin); author[strcspn(author,"\n")]=0;
+                int place = holdPosition(id, author);
+                if(place) printf("%s is number %d on hold.\n", author, place);
+                else printf("%s has no hold on this book.\n", author);
+                break;
+            }
+
+            case 25:
+                printf("Enter Book ID: "); scanf("%d", &id); getchar();
+                printf("Enter Patron Name: ");
+                fgets(author, 50, stdin); author[strcspn(author,"\n")]=0;
+                if(cancelHold(id, author)) printf("Hold cancelled.\n");
+                else printf("%s has no hold on this book.\n", author);
+                break;
+
+            case 26:
+                printf("Enter Section Name: ");
+                fgets(secName, 50, stdin); secName[strcspn(secName,"\n")]=0;
+                sec = findSection(library, secName);
+                if(sec) {
+                    orderSection(sec);
+                    printf("Section '%s' now keeps its books in ID order.\n", sec->name);
+                } else printf("Section not found.\n");
+                break;
+
+            case 27:
+                printf("Enter Section Name (blank for the whole library): ");
+                fgets(secName, 50, stdin); secName[strcspn(secName,"\n")]=0;
+                sec = secName[0] ? findSection(library, secName) : NULL;
+                if(sec || !secName[0]) {
+                    int lo, hi;
+                    printf("Enter First and Last ID: "); scanf("%d %d", &lo, &hi); getchar();
+                    if(sec) displayRange(sec, lo, hi);
+                    else displayCatalogRange(lo, hi);
+                } else printf("Section not found.\n");
+                break;
+
+            case 28: {
+                char toSec[50];
+                printf("Enter the name of the section to move books FROM: ");
+                fgets(secName, 50, stdin); secName[strcspn(secName,"\n")]=0;
+                printf("Enter the name of the section to move books TO: ");
+                fgets(toSec, 50, stdin); toSec[strcspn(toSec,"\n")]=0;
+                Section* dest = findSection(library, toSec);
+                sec = findSection(library, secName);
+                if(sec && dest) {
+                    int range[2];
+                    printf("Enter First and Last ID: "); scanf("%d %d", &range[0], &range[1]); getchar();
+                    size_t moved = moveBooksInRange(sec, dest, range[0], range[1]);
+                    printf("Moved %zu copies from '%s' to '%s'.\n", moved, sec->name, dest->name);
+                } else printf("One or both sections not found!\n");
+                break;
+            }
+
             
 
             default:
@@ -328,8 +6423,13 @@ int main() {
 
     } while(choice != 9);
 
+    if(snapshotPath && !saveSnapshot(library, snapshotPath))
+        printf("Could not write snapshot '%s'\n", snapshotPath);
+
     // Free memory
-    while(library) library = deleteSection(library, library->name);
+    freeLibrary(library);
 
     return 0;
-}
\ No newline at end of file
+}
+
+#endif // LIBRARY_NO_MAIN
\ No newline at end of file
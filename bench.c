@@ -0,0 +1,727 @@
+// Benchmark for the catalog operations in Librabry.c.
+//
+// Build and run:
+//   gcc -O2 -pthread bench.c -o bench
+//   ./bench [--books N[,N...]] [--per-section K] [--ids seq|uniform|dup]
+//           [--title-len L] [--author-len L] [--seed S] [--stress THREADS]
+//           [--sections plain|ordered] [--check]
+//
+// For every catalog size it generates a synthetic catalog and reports
+// throughput and p50/p99 latency of each operation, plus the time to
+// save the catalog to a snapshot, free it and load it back. With --stress it
+// instead runs desk threads against one shared catalog and checks that
+// no book was lost or issued twice. --check runs a few scripted desk
+// scenarios whose outcome is known and reports any that come out wrong.
+
+#define LIBRARY_NO_MAIN
+#include "Librabry.c"
+
+// --- Settings ---
+#define MAX_SCALES 16
+#define MAX_SAMPLES (1 << 20) // latency samples kept per operation
+
+enum { IDS_SEQ, IDS_UNIFORM, IDS_DUP };
+
+typedef struct BenchConfig
+{
+    long scales[MAX_SCALES];
+    int scaleCount;
+    long perSection;
+    int idMode;
+    int titleLen;
+    int authorLen;
+    unsigned long long seed;
+    int stressThreads;    // 0 = normal benchmark
+    int ordered;          // sections kept sorted by ID
+    int check;            // run the scripted checks instead
+} BenchConfig;
+
+// --- Helpers ---
+static unsigned long long rngState;
+
+static unsigned long long stepRandom(unsigned long long* state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static unsigned long long nextRandom(void)
+{
+    return stepRandom(&rngState);
+}
+
+static long randomBelow(long n)
+{
+    return (long)(nextRandom() % (unsigned long long)n);
+}
+
+static long long nowNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void randomText(char out[50], int len)
+{
+    for(int i = 0; i < len; i++)
+        out[i] = (char)('a' + randomBelow(26));
+    out[len] = 0;
+}
+
+// Latency samples for one operation; long runs keep every `stride`-th
+typedef struct Timing
+{
+    const char* name;
+    long ops;
+    long long totalNs;
+    long long* samples;
+    long sampleCount;
+    long stride;
+} Timing;
+
+static void timingStart(Timing* t, const char* name, long expectedOps)
+{
+    t->name = name;
+    t->ops = 0;
+    t->totalNs = 0;
+    t->sampleCount = 0;
+    t->stride = expectedOps / MAX_SAMPLES + 1;
+    if(!t->samples)
+        t->samples = (long long*)malloc(sizeof(long long) * MAX_SAMPLES);
+}
+
+static void timingAdd(Timing* t, long long ns)
+{
+    if(t->ops % t->stride == 0 && t->sampleCount < MAX_SAMPLES)
+        t->samples[t->sampleCount++] = ns;
+    t->ops++;
+    t->totalNs += ns;
+}
+
+static int compareLongLong(const void* a, const void* b)
+{
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static void timingReport(Timing* t)
+{
+    if(!t->ops)
+        return;
+    qsort(t->samples, (size_t)t->sampleCount, sizeof(long long), compareLongLong);
+    long long p50 = t->samples[t->sampleCount / 2];
+    long long p99 = t->samples[(t->sampleCount * 99) / 100];
+    double secs = t->totalNs / 1e9;
+    printf("  %-12s %10ld ops %14.0f ops/s   p50 %8lld ns   p99 %8lld ns\n",
+           t->name, t->ops, secs > 0 ? t->ops / secs : 0.0, p50, p99);
+}
+
+// --- Benchmark ---
+static int countBook(Book* b, void* ctx)
+{
+    (void)b;
+    (void)ctx;
+    return 1;
+}
+
+static int countInCatalog(Book* b, Section* sec, void* ctx)
+{
+    (void)b;
+    (void)sec;
+    (void)ctx;
+    return 1;
+}
+
+static void runScale(const BenchConfig* cfg, long books)
+{
+    long sections = books / cfg->perSection;
+    if(sections < 1)
+        sections = 1;
+    long idRange = cfg->idMode == IDS_DUP ? books / 4 + 1 : books;
+    char name[50], title[50], author[50];
+    Timing t = { 0 };
+    long long start;
+
+    printf("\n%ld books, %ld %ssections, ids=%s\n", books, sections, cfg->ordered ? "ordered " : "",
+           cfg->idMode == IDS_SEQ ? "seq" : cfg->idMode == IDS_UNIFORM ? "uniform" : "dup");
+
+    // IDs actually inserted, so later phases hit existing books
+    int* ids = (int*)malloc(sizeof(int) * (size_t)books);
+    Section** secs = (Section**)malloc(sizeof(Section*) * (size_t)sections);
+    Section* library = NULL;
+
+    timingStart(&t, "addSection", sections);
+    for(long i = 0; i < sections; i++) {
+        snprintf(name, sizeof(name), "Section %ld", i);
+        start = nowNs();
+        library = addSection(library, name);
+        timingAdd(&t, nowNs() - start);
+        secs[i] = library;
+        if(cfg->ordered)
+            orderSection(library);
+    }
+    timingReport(&t);
+
+    timingStart(&t, "findSection", books);
+    for(long i = 0; i < books; i++) {
+        snprintf(name, sizeof(name), "Section %ld", randomBelow(sections));
+        start = nowNs();
+        Section* sec = findSection(library, name);
+        timingAdd(&t, nowNs() - start);
+        if(!sec)
+            abort();
+    }
+    timingReport(&t);
+
+    timingStart(&t, "addBook", books);
+    for(long i = 0; i < books; i++) {
+        ids[i] = cfg->idMode == IDS_SEQ ? (int)i : (int)randomBelow(idRange);
+        randomText(title, cfg->titleLen);
+        randomText(author, cfg->authorLen);
+        Section* sec = secs[randomBelow(sections)];
+        start = nowNs();
+        addBook(sec, ids[i], title, author);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    timingStart(&t, "issueBook", books);
+    for(long i = 0; i < books; i++) {
+        int id = ids[randomBelow(books)];
+        start = nowNs();
+        issueBookById(id);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    timingStart(&t, "returnBook", books);
+    for(long i = 0; i < books; i++) {
+        int id = ids[randomBelow(books)];
+        start = nowNs();
+        returnBookById(id);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    long moves = books / 10 + 1;
+    timingStart(&t, "moveBook", moves);
+    for(long i = 0; i < moves; i++) {
+        int id = ids[randomBelow(books)];
+        BookSlot* slot = indexFind(NULL, id, -1);
+        if(!slot)
+            continue;
+        Section* source = slot->section;
+        Section* dest = secs[randomBelow(sections)];
+        start = nowNs();
+        moveBookBetween(source, dest, id);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    // Bulk moves of up to 100 of a section's books at a time
+    long batches = moves / 100 + 1;
+    int batch[100];
+    timingStart(&t, "moveBooks", batches);
+    for(long i = 0; i < batches; i++) {
+        Section* source = secs[randomBelow(sections)];
+        Section* dest = secs[randomBelow(sections)];
+        size_t n = 0;
+        for(Book* b = source->books; b && n < 100; b = b->next)
+            batch[n++] = b->id;
+        start = nowNs();
+        moveBooks(source, dest, batch, n);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    // ID spans holding about ten of a section's books
+    long span = 10 * idRange / (books / sections) + 1;
+    long queries = books / 10 + 1;
+    timingStart(&t, "rangeQuery", queries);
+    for(long i = 0; i < queries; i++) {
+        int lo = (int)randomBelow(idRange);
+        Section* sec = secs[randomBelow(sections)];
+        start = nowNs();
+        booksInRange(sec, lo, lo + (int)span - 1, countBook, NULL);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    // Same number of books per query, drawn from the whole catalog
+    span = 10 * idRange / books + 1;
+    timingStart(&t, "catalogRange", queries);
+    for(long i = 0; i < queries; i++) {
+        int lo = (int)randomBelow(idRange);
+        start = nowNs();
+        catalogRange(lo, lo + (int)span - 1, countInCatalog, NULL);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    timingStart(&t, "sortBooks", sections);
+    for(long i = 0; i < sections; i++) {
+        start = nowNs();
+        sortBooks(secs[i], 2, 1);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    // Save, free and load the catalog back, each timed once; the
+    // loaded catalog must hold every title and copy. Section pointers
+    // are stale from here on, so later phases go by ID only.
+    char snapPath[64];
+    snprintf(snapPath, sizeof(snapPath), "/tmp/bench-%d.snap", (int)getpid());
+    long titles = (long)bookIndex.count, copies = stats.books;
+    start = nowNs();
+    int saved = saveSnapshot(library, snapPath);
+    double saveSecs = (nowNs() - start) / 1e9;
+    start = nowNs();
+    freeLibrary(library);
+    double freeSecs = (nowNs() - start) / 1e9;
+    start = nowNs();
+    library = loadSnapshot(NULL, snapPath);
+    double loadSecs = (nowNs() - start) / 1e9;
+    remove(snapPath);
+    printf("  %-12s %10ld books %13.3f s\n", "saveSnapshot", copies, saveSecs);
+    printf("  %-12s %10ld books %13.3f s\n", "freeLibrary", copies, freeSecs);
+    printf("  %-12s %10ld books %13.3f s\n", "loadSnapshot", copies, loadSecs);
+    if(!saved || stats.books != copies || (long)bookIndex.count != titles)
+        printf("  FAILED: snapshot came back with %ld books, %zu titles\n", stats.books, bookIndex.count);
+
+    timingStart(&t, "deleteBook", books);
+    for(long i = 0; i < books; i++) {
+        start = nowNs();
+        deleteBookById(ids[i]);
+        timingAdd(&t, nowNs() - start);
+    }
+    timingReport(&t);
+
+    freeLibrary(library);
+    free(t.samples);
+    free(secs);
+    free(ids);
+}
+
+// --- Stress Test ---
+// Every thread works on the same catalog: issue/reserve/return/move
+// (single and bulk) of shared books (IDs 0..N-1, one copy each), sorts, plus add/delete of
+// two-copy books and whole sections private to the thread. Every other
+// section is kept ordered by ID, so moves cross both kinds. Successful
+// issues and returns are counted per ID, a return handed to a hold
+// counting as both, so afterwards each ID's net count must match its status.
+
+typedef struct StressShared
+{
+    Section** secs;
+    long sections;
+    long books;
+    long opsPerThread;
+    long* issues;         // successful issueBookById per shared ID
+    long* returns;
+    long failures;        // private add/delete that didn't round-trip
+} StressShared;
+
+typedef struct StressThread
+{
+    StressShared* shared;
+    int index;
+    unsigned long long rng;
+    pthread_t thread;
+} StressThread;
+
+// Current section of a shared book; it may move again before it's used
+static Section* stressSectionOf(int id)
+{
+    pthread_rwlock_rdlock(&catalogLock);
+    Section* sec = sectionHolding(NULL, id, -1);
+    pthread_rwlock_unlock(&catalogLock);
+    return sec;
+}
+
+static void* stressWorker(void* arg)
+{
+    StressThread* t = (StressThread*)arg;
+    StressShared* sh = t->shared;
+    int privateId = (int)sh->books + t->index * 1000000;
+    char name[50], title[50] = "private", author[50] = "desk", patron[50];
+    snprintf(patron, sizeof(patron), "desk-%d", t->index);
+
+    for(long op = 0; op < sh->opsPerThread; op++) {
+        unsigned long long r = stepRandom(&t->rng);
+        int id = (int)((r >> 8) % (unsigned long long)sh->books);
+        int kind = (int)(r % 100);
+        if(kind < 30) {
+            if(issueBookById(id))
+                __atomic_add_fetch(&sh->issues[id], 1, __ATOMIC_RELAXED);
+        } else if(kind < 35) {
+            if(reserveBook(id, patron) == 0)
+                __atomic_add_fetch(&sh->issues[id], 1, __ATOMIC_RELAXED);
+        } else if(kind < 70) {
+            int done = returnBookById(id);
+            if(done)
+                __atomic_add_fetch(&sh->returns[id], 1, __ATOMIC_RELAXED);
+            if(done == 2)
+                __atomic_add_fetch(&sh->issues[id], 1, __ATOMIC_RELAXED);
+        } else if(kind < 83) {
+            Section* from = stressSectionOf(id);
+            Section* to = sh->secs[(r >> 40) % (unsigned long long)sh->sections];
+            if(from)
+                moveBookBetween(from, to, id);
+        } else if(kind < 85) {
+            // bulk move of a small window of shared IDs between two sections
+            int window[2] = { id, id + 16 < sh->books ? id + 15 : (int)sh->books - 1 };
+            Section* from = sh->secs[(r >> 40) % (unsigned long long)sh->sections];
+            Section* to = sh->secs[(r >> 20) % (unsigned long long)sh->sections];
+            moveBooksInRange(from, to, window[0], window[1]);
+        } else if(kind < 96) {
+            Section* sec = sh->secs[(r >> 40) % (unsigned long long)sh->sections];
+            addBook(sec, privateId, title, author);
+            addBook(sec, privateId, title, author);
+            issueBook(sec, privateId);
+            if(!deleteBookById(privateId) || !deleteBookById(privateId) || deleteBookById(privateId))
+                __atomic_add_fetch(&sh->failures, 1, __ATOMIC_RELAXED);
+        } else if(kind < 99) {
+            snprintf(name, sizeof(name), "scratch-%d", t->index);
+            Section* sec = addSection(NULL, name);
+            addBook(sec, privateId, title, author);
+            issueBook(sec, privateId);
+            deleteSection(NULL, name);
+        } else {
+            sortBooks(sh->secs[(r >> 40) % (unsigned long long)sh->sections], (int)(r >> 60) % 3 + 1, 1);
+        }
+    }
+    return NULL;
+}
+
+// An ordered section's list must be sorted by ID, and each skip list
+// level must link exactly the books tall enough for it, in list order
+static long verifySkipList(Section* sec)
+{
+    long errors = 0;
+    for(Book* b = sec->books; b; b = b->next) {
+        if((sec->skip && b->next && b->next->id <= b->id) ||
+           (b->tower ? b->tower->height : 1) != (sec->skip ? skipHeight(b->id) : 1))
+            errors++;
+    }
+    for(int level = 1; sec->skip && level < SKIP_MAX_LEVEL; level++) {
+        Book* expect = sec->books;
+        Book* b = level < sec->skip->height ? sec->skip->next[level - 1] : NULL;
+        for(;; b = b->tower->next[level - 1], expect = expect->next) {
+            while(expect && skipHeight(expect->id) <= level)
+                expect = expect->next;
+            if(b != expect) {
+                errors++;
+                break;
+            }
+            if(!b)
+                break;
+        }
+    }
+    return errors;
+}
+
+// The catalog ID tree must list every title once, in key order, with
+// the section the book index has for it
+static long verifyIdTree(void)
+{
+    long errors = 0;
+    size_t entries = 0;
+    BTreeLeaf* last = NULL;
+    for(BTreeLeaf* leaf = idTree.first; leaf; last = leaf, leaf = leaf->next) {
+        for(int i = 0; i < leaf->count; i++, entries++) {
+            if(leaf->books[i]->id != leaf->ids[i] || indexSlotOf(leaf->books[i])->section != leaf->sections[i])
+                errors++;
+            if(i > 0 ? !idKeyLess(leaf->ids[i - 1], leaf->books[i - 1], leaf->ids[i], leaf->books[i])
+                     : last && !idKeyLess(last->ids[last->count - 1], last->books[last->count - 1], leaf->ids[i], leaf->books[i]))
+                errors++;
+        }
+    }
+    if(entries != idTree.count || entries != bookIndex.count)
+        errors++;
+    return errors;
+}
+
+// Walks every structure and compares it with the per-ID counts
+static long stressVerify(const StressShared* sh)
+{
+    long errors = sh->failures, books = 0, issued = 0;
+    for(long i = 0; i < sh->sections; i++) {
+        Section* sec = sh->secs[i];
+        int listed = 0, out = 0, copies = 0;
+        for(Book* b = sec->books; b; b = b->next, listed++) {
+            BookSlot* slot = indexSlotOf(b);
+            int titleOut = columnCopies(sec, b->col) - columnOnShelf(sec, b->col), loans = 0;
+            if(slot->section != sec || sec->nodes[b->col] != b || sec->ids[b->col] != b->id ||
+               titleOut < 0 || columnAvailable(sec, b->col) != (titleOut < columnCopies(sec, b->col)))
+                errors++;
+            copies += columnCopies(sec, b->col);
+            out += titleOut;
+            // every issue here goes through issueBook, so one open loan per copy out
+            const LoanTable* t = &loanStripe(b->id)->loans;
+            for(uint32_t l = slot->loan; l; l = t->slots[l - 1].older, loans++) {
+                if(t->slots[l - 1].book != b)
+                    errors++;
+            }
+            if(loans != titleOut)
+                errors++;
+        }
+        if(listed != sec->count || copies != sec->copyCount || out != sec->issued)
+            errors++;
+        errors += verifySkipList(sec);
+        books += sec->copyCount;
+        issued += sec->issued;
+    }
+    if(books != sh->books || books != stats.books || issued != stats.issued ||
+       (long)bookIndex.count != sh->books || stats.sections != sh->sections ||
+       loanCount() != (uint32_t)issued)
+        errors++;
+    errors += verifyIdTree();
+    for(long id = 0; id < sh->books; id++) {
+        BookSlot* s = indexFind(NULL, (int)id, -1);
+        long net = sh->issues[id] - sh->returns[id];
+        if(!s || (net != 0 && net != 1) || net != columnCopies(s->section, s->col) - columnOnShelf(s->section, s->col))
+            errors++;
+        // a copy only reaches the shelf when nobody is waiting for it
+        if(s && holdFind(&loanStripe((int)id)->holds, (int)id) && columnOnShelf(s->section, s->col))
+            errors++;
+    }
+    return errors;
+}
+
+static int runStress(const BenchConfig* cfg)
+{
+    StressShared sh = { 0 };
+    sh.books = cfg->scales[0];
+    sh.sections = sh.books / cfg->perSection > 1 ? sh.books / cfg->perSection : 2;
+    sh.opsPerThread = sh.books > 100000 ? sh.books : 100000;
+    sh.secs = (Section**)malloc(sizeof(Section*) * (size_t)sh.sections);
+    sh.issues = (long*)calloc((size_t)sh.books, sizeof(long));
+    sh.returns = (long*)calloc((size_t)sh.books, sizeof(long));
+    char name[50], title[50], author[50];
+    Section* library = NULL;
+
+    for(long i = 0; i < sh.sections; i++) {
+        snprintf(name, sizeof(name), "Section %ld", i);
+        sh.secs[i] = library = addSection(library, name);
+        if(i % 2)
+            orderSection(library);
+    }
+    for(long i = 0; i < sh.books; i++) {
+        randomText(title, cfg->titleLen);
+        randomText(author, cfg->authorLen);
+        addBook(sh.secs[randomBelow(sh.sections)], (int)i, title, author);
+    }
+
+    printf("\nStress: %d threads x %ld ops, %ld books, %ld sections\n",
+           cfg->stressThreads, sh.opsPerThread, sh.books, sh.sections);
+    StressThread* threads = (StressThread*)calloc((size_t)cfg->stressThreads, sizeof(StressThread));
+    long long start = nowNs();
+    for(int i = 0; i < cfg->stressThreads; i++) {
+        threads[i].shared = &sh;
+        threads[i].index = i;
+        threads[i].rng = nextRandom() | 1;
+        pthread_create(&threads[i].thread, NULL, stressWorker, &threads[i]);
+    }
+    for(int i = 0; i < cfg->stressThreads; i++)
+        pthread_join(threads[i].thread, NULL);
+    double secs = (nowNs() - start) / 1e9;
+    long total = sh.opsPerThread * cfg->stressThreads;
+    printf("  %ld ops in %.2f s (%.0f ops/s)\n", total, secs, total / secs);
+
+    long errors = stressVerify(&sh);
+    if(errors)
+        printf("  FAILED: %ld inconsistencies\n", errors);
+    else
+        printf("  OK: no book lost or issued twice\n");
+
+    freeLibrary(library);
+    free(threads);
+    free(sh.secs);
+    free(sh.issues);
+    free(sh.returns);
+    return errors ? 1 : 0;
+}
+
+// --- Checks ---
+// Each check drives the public catalog API through a short script and
+// returns the number of steps that came out wrong, printing each one.
+
+static int firstBorrower(const Loan* loan, void* ctx)
+{
+    snprintf((char*)ctx, 50, "%s", loan->borrower);
+    return 1;
+}
+
+// The catalog must hold exactly one open loan, issued to `want`
+static long expectOnlyLoan(const char* step, const char* want)
+{
+    char name[50] = "";
+    size_t n = overdueLoans(time(NULL) + 365 * 86400, firstBorrower, name);
+    if(n == 1 && strcmp(name, want) == 0)
+        return 0;
+    printf("  FAILED: %s: %zu loans open, expected only %s's (got %s)\n", step, n, want, name);
+    return 1;
+}
+
+// Two borrowers on one title: a named return closes that borrower's
+// loan, an anonymous return or a delete closes the oldest
+static long checkLoans(void)
+{
+    long errors = 0;
+    time_t now = time(NULL);
+    Section* sec = addSection(NULL, "Loans");
+    addBook(sec, 101, "Dune", "Frank Herbert");
+    addBook(sec, 101, "Dune", "Frank Herbert");
+
+    issueBookTo(NULL, 101, "Ana", now + 86400);
+    issueBookTo(NULL, 101, "Bob", now + 30 * 86400);
+    if(returnBookById(101) != 1) {
+        printf("  FAILED: anonymous return refused\n");
+        errors++;
+    }
+    errors += expectOnlyLoan("anonymous return", "Bob");
+
+    issueBookTo(NULL, 101, "Ana", now + 86400);
+    if(returnBookFrom(NULL, 101, "Cy")) {
+        printf("  FAILED: return by a borrower with no copy out accepted\n");
+        errors++;
+    }
+    if(returnBookFrom(NULL, 101, "Ana") != 1) {
+        printf("  FAILED: Ana's return refused\n");
+        errors++;
+    }
+    errors += expectOnlyLoan("named return", "Bob");
+
+    issueBookTo(NULL, 101, "Ana", now + 86400);
+    deleteBookById(101);
+    errors += expectOnlyLoan("deleting an issued copy", "Ana");
+
+    freeLibrary(sec);
+    return errors;
+}
+
+// Section names are unique: the log and the server go by name
+static long checkSectionNames(void)
+{
+    long errors = 0;
+    Section* sec = addSection(NULL, "S0");
+    addBook(sec, 103, "t", "a");
+    if(addSection(NULL, "S0")) {
+        printf("  FAILED: a second section named S0 was added\n");
+        errors++;
+    }
+    if(findSection(NULL, "S0") != sec || !issueBookTo(NULL, 103, "Di", time(NULL) + 86400)) {
+        printf("  FAILED: S0 no longer finds its book\n");
+        errors++;
+    }
+    freeLibrary(sec);
+    return errors;
+}
+
+// Two records of one ID with different titles: a multi-word search must
+// not match by taking one word from each
+static long checkKeywords(void)
+{
+    long errors = 0;
+    int* ids;
+    Section* a = addSection(NULL, "A");
+    Section* b = addSection(NULL, "B");
+    addBook(a, 5, "roman history", "x");
+    addBook(b, 5, "empire state", "y");
+    addBook(b, 6, "roman empire", "z");
+    size_t n = searchKeywords("roman empire", &ids);
+    if(n != 1 || ids[0] != 6) {
+        printf("  FAILED: 'roman empire' matched %zu IDs\n", n);
+        errors++;
+    }
+    free(ids);
+    freeLibrary(a);
+    return errors;
+}
+
+static int runChecks(void)
+{
+    static const struct { const char* name; long (*run)(void); } checks[] = {
+        { "loans", checkLoans },
+        { "sections", checkSectionNames },
+        { "keywords", checkKeywords },
+    };
+    long failed = 0;
+    printf("\nChecks:\n");
+    for(size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        long errors = checks[i].run();
+        printf("  %-12s %s\n", checks[i].name, errors ? "FAILED" : "OK");
+        failed += errors != 0;
+    }
+    return failed ? 1 : 0;
+}
+
+static int parseScales(BenchConfig* cfg, char* list)
+{
+    cfg->scaleCount = 0;
+    for(char* tok = strtok(list, ","); tok && cfg->scaleCount < MAX_SCALES; tok = strtok(NULL, ",")) {
+        long n = atol(tok);
+        if(n <= 0)
+            return 0;
+        cfg->scales[cfg->scaleCount++] = n;
+    }
+    return cfg->scaleCount > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchConfig cfg = { { 1000, 10000, 100000, 1000000 }, 4, 1000, IDS_UNIFORM, 20, 12, 42, 0, 0, 0 };
+
+    for(int i = 1; i < argc; i++) {
+        int ok = i + 1 < argc;
+        if(strcmp(argv[i], "--check") == 0)
+            ok = cfg.check = 1;
+        else if(ok && strcmp(argv[i], "--books") == 0)
+            ok = parseScales(&cfg, argv[++i]);
+        else if(ok && strcmp(argv[i], "--per-section") == 0)
+            ok = (cfg.perSection = atol(argv[++i])) > 0;
+        else if(ok && strcmp(argv[i], "--ids") == 0) {
+            const char* mode = argv[++i];
+            if(strcmp(mode, "seq") == 0) cfg.idMode = IDS_SEQ;
+            else if(strcmp(mode, "uniform") == 0) cfg.idMode = IDS_UNIFORM;
+            else if(strcmp(mode, "dup") == 0) cfg.idMode = IDS_DUP;
+            else ok = 0;
+        }
+        else if(ok && strcmp(argv[i], "--title-len") == 0)
+            ok = (cfg.titleLen = atoi(argv[++i])) > 0 && cfg.titleLen < 50;
+        else if(ok && strcmp(argv[i], "--author-len") == 0)
+            ok = (cfg.authorLen = atoi(argv[++i])) > 0 && cfg.authorLen < 50;
+        else if(ok && strcmp(argv[i], "--seed") == 0)
+            cfg.seed = strtoull(argv[++i], NULL, 10);
+        else if(ok && strcmp(argv[i], "--stress") == 0)
+            ok = (cfg.stressThreads = atoi(argv[++i])) > 0;
+        else if(ok && strcmp(argv[i], "--sections") == 0) {
+            const char* mode = argv[++i];
+            if(strcmp(mode, "plain") == 0) cfg.ordered = 0;
+            else if(strcmp(mode, "ordered") == 0) cfg.ordered = 1;
+            else ok = 0;
+        }
+        else
+            ok = 0;
+
+        if(!ok) {
+            fprintf(stderr, "Usage: %s [--books N[,N...]] [--per-section K] [--ids seq|uniform|dup]\n"
+                            "          [--title-len L] [--author-len L] [--seed S] [--stress THREADS]\n"
+                            "          [--sections plain|ordered] [--check]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    rngState = cfg.seed ? cfg.seed : 1;
+    if(cfg.check)
+        return runChecks();
+    if(cfg.stressThreads)
+        return runStress(&cfg);
+    for(int i = 0; i < cfg.scaleCount; i++)
+        runScale(&cfg, cfg.scales[i]);
+    return 0;
+}
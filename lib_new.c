@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define USER_FILE "users.txt"
 
@@ -19,6 +23,27 @@ typedef struct Section {
     struct Section* next;
 } Section;
 
+// What a session may do; computed from the role once at login
+#define CAP_CIRCULATE       1u  // issue and return
+#define CAP_MANAGE_BOOKS    2u  // add and delete books
+#define CAP_MANAGE_SECTIONS 4u  // add and delete sections
+
+#define SALT_BYTES 16
+
+typedef struct User {
+    char name[50];
+    char role[20];
+    unsigned char salt[SALT_BYTES];
+    unsigned char hash[32];
+    int used;
+} User;
+
+typedef struct Session {
+    char name[50];
+    char role[20];
+    unsigned int caps;
+} Session;
+
 // --- Function Prototypes ---
 Section* addSection(Section* head, char name[]);
 Section* findSection(Section* head, char name[]);
@@ -29,7 +54,9 @@ int issueBook(Section* sec, int id);
 int returnBook(Section* sec, int id);
 int deleteBook(Section* sec, int id);
 Section* deleteSection(Section* head, char name[]);
-int login(char* role);
+int loadUsers(const char* path);
+int login(Session* session);
+void freeUsers(void);
 
 // --- Function Implementations ---
 Section* addSection(Section* head, char name[]) {
@@ -155,19 +182,346 @@ Section* deleteSection(Section* head, char name[]) {
 }
 
 // --- User Login System ---
-int login(char* role) {
-    char username[50], password[50], fileUser[50], filePass[50], fileRole[20];
-    FILE* fp = fopen(USER_FILE, "r");
+// users.txt starts with a USERS_HEADER line and then holds one
+// "username password role" line per account. The password field is
+// stored as "$s$<salt>$<hash>": a random 16-byte salt and SHA-256
+// stretched over HASH_ROUNDS rounds, both in hex. A file without the
+// header is the old format, where every password is plaintext; it is
+// hashed on load and the file rewritten with the header, so a plaintext
+// password that happens to look like a hash is never taken for one. The
+// whole file is read once into a hash table keyed by username, so a
+// login is one lookup plus one password hash.
+
+#define USERS_HEADER "#library-users 2"
+#define HASH_ROUNDS 1000
+#define USERS_MIN_CAPACITY 64
+
+static User* users;
+static size_t userCapacity; // always a power of two
+static size_t userCount;
+
+// SHA-256 (FIPS 180-4), enough of it to hash short passwords
+typedef struct Sha256 {
+    uint32_t state[8];
+    unsigned char block[64];
+    size_t blockLen;
+    uint64_t totalLen;
+} Sha256;
+
+static const uint32_t shaK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Block(Sha256* c, const unsigned char* p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+               (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = c->state[0], b = c->state[1], cc = c->state[2], d = c->state[3];
+    uint32_t e = c->state[4], f = c->state[5], g = c->state[6], h = c->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + shaK[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & cc) ^ (b & cc));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = cc;
+        cc = b;
+        b = a;
+        a = t1 + t2;
+    }
+    c->state[0] += a;
+    c->state[1] += b;
+    c->state[2] += cc;
+    c->state[3] += d;
+    c->state[4] += e;
+    c->state[5] += f;
+    c->state[6] += g;
+    c->state[7] += h;
+}
+
+static void sha256Init(Sha256* c) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(c->state, init, sizeof(init));
+    c->blockLen = 0;
+    c->totalLen = 0;
+}
+
+static void sha256Update(Sha256* c, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    c->totalLen += len;
+    while (len) {
+        size_t n = 64 - c->blockLen < len ? 64 - c->blockLen : len;
+        memcpy(c->block + c->blockLen, p, n);
+        c->blockLen += n;
+        p += n;
+        len -= n;
+        if (c->blockLen == 64) {
+            sha256Block(c, c->block);
+            c->blockLen = 0;
+        }
+    }
+}
+
+static void sha256Final(Sha256* c, unsigned char out[32]) {
+    uint64_t bits = c->totalLen * 8;
+    c->block[c->blockLen++] = 0x80;
+    if (c->blockLen > 56) {
+        memset(c->block + c->blockLen, 0, 64 - c->blockLen);
+        sha256Block(c, c->block);
+        c->blockLen = 0;
+    }
+    memset(c->block + c->blockLen, 0, 56 - c->blockLen);
+    for (int i = 0; i < 8; i++)
+        c->block[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256Block(c, c->block);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (unsigned char)(c->state[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(c->state[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(c->state[i] >> 8);
+        out[4 * i + 3] = (unsigned char)c->state[i];
+    }
+}
+
+// hash = SHA-256(salt | password), then HASH_ROUNDS - 1 times SHA-256(hash | password)
+static void hashPassword(const unsigned char salt[SALT_BYTES], const char* password, unsigned char out[32]) {
+    size_t len = strlen(password);
+    Sha256 c;
+    sha256Init(&c);
+    sha256Update(&c, salt, SALT_BYTES);
+    sha256Update(&c, password, len);
+    sha256Final(&c, out);
+    for (int i = 1; i < HASH_ROUNDS; i++) {
+        sha256Init(&c);
+        sha256Update(&c, out, 32);
+        sha256Update(&c, password, len);
+        sha256Final(&c, out);
+    }
+}
+
+static void randomSalt(unsigned char salt[SALT_BYTES]) {
+    FILE* fp = fopen("/dev/urandom", "rb");
+    if (!fp || fread(salt, 1, SALT_BYTES, fp) != SALT_BYTES) {
+        // No urandom: fall back to something that at least differs per user
+        static uint64_t x;
+        x ^= (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)salt ^ 0x9e3779b97f4a7c15ULL;
+        for (int i = 0; i < SALT_BYTES; i++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            salt[i] = (unsigned char)(x >> 56);
+        }
+    }
+    if (fp)
+        fclose(fp);
+}
+
+static void toHex(char* out, const unsigned char* bytes, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < n; i++) {
+        out[2 * i] = hex[bytes[i] >> 4];
+        out[2 * i + 1] = hex[bytes[i] & 15];
+    }
+    out[2 * n] = 0;
+}
+
+static int fromHex(unsigned char* out, const char* text, size_t n) {
+    for (size_t i = 0; i < 2 * n; i++) {
+        char c = text[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (v < 0)
+            return 0;
+        out[i / 2] = (unsigned char)(i % 2 ? out[i / 2] | v : v << 4);
+    }
+    return 1;
+}
+
+// Parse "$s$<32 hex>$<64 hex>"
+static int parseStoredHash(const char* text, User* u) {
+    return strlen(text) == 3 + 2 * SALT_BYTES + 1 + 64 &&
+           strncmp(text, "$s$", 3) == 0 && text[3 + 2 * SALT_BYTES] == '$' &&
+           fromHex(u->salt, text + 3, SALT_BYTES) &&
+           fromHex(u->hash, text + 4 + 2 * SALT_BYTES, 32);
+}
+
+static size_t hashUsername(const char* name) {
+    size_t h = 2166136261u; // FNV-1a
+    for (; *name; name++) {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot holding `name`, or the empty slot where it belongs
+static User* userSlot(User* table, size_t capacity, const char* name) {
+    size_t mask = capacity - 1;
+    size_t i = hashUsername(name) & mask;
+    while (table[i].used && strcmp(table[i].name, name) != 0)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+static User* findUser(const char* name) {
+    if (!userCapacity)
+        return NULL;
+    User* u = userSlot(users, userCapacity, name);
+    return u->used ? u : NULL;
+}
+
+static User* addUser(const char* name) {
+    if ((userCount + 1) * 2 > userCapacity) {
+        size_t newCap = userCapacity ? userCapacity * 2 : USERS_MIN_CAPACITY;
+        User* table = (User*)calloc(newCap, sizeof(User));
+        if (!table) {
+            printf("Out of memory while loading users!\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < userCapacity; i++) {
+            if (users[i].used)
+                *userSlot(table, newCap, users[i].name) = users[i];
+        }
+        free(users);
+        users = table;
+        userCapacity = newCap;
+    }
+    User* u = userSlot(users, userCapacity, name);
+    if (!u->used) {
+        memset(u, 0, sizeof(*u));
+        strcpy(u->name, name);
+        u->used = 1;
+        userCount++;
+    }
+    return u; // a repeated username keeps its last line, as before
+}
+
+// fsync the directory holding `path`, so a rename into it survives a
+// crash. Returns 0 if that failed.
+static int syncDirOf(const char* path) {
+    char dir[1024];
+    const char* slash = strrchr(path, '/');
+    if (!slash)
+        snprintf(dir, sizeof(dir), ".");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Write the table to a temporary file, flush it to disk and rename it
+// over `path`, so a crash mid-save leaves the old file intact. The
+// directory is synced too, or the rename itself could be lost.
+static int saveUsers(const char* path) {
+    char tmpPath[1024], salt[2 * SALT_BYTES + 1], hash[65];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    FILE* fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp) {
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    fprintf(fp, "%s\n", USERS_HEADER);
+    for (size_t i = 0; i < userCapacity; i++) {
+        if (!users[i].used)
+            continue;
+        toHex(salt, users[i].salt, SALT_BYTES);
+        toHex(hash, users[i].hash, 32);
+        fprintf(fp, "%s $s$%s$%s %s\n", users[i].name, salt, hash, users[i].role);
+    }
+    int ok = !ferror(fp);
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+        ok = 0;
+    if (fclose(fp) != 0)
+        ok = 0;
+    if (!ok || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+        return 0;
+    }
+    return syncDirOf(path);
+}
+
+// Read the user file into the table once. Creates the default accounts if
+// the file is missing and hashes the passwords of an old-format file.
+int loadUsers(const char* path) {
+    char line[300], name[50], password[200], role[20];
+    FILE* fp = fopen(path, "r");
 
     if (!fp) {
         printf("User file not found! Creating default users...\n");
-        fp = fopen(USER_FILE, "w");
-        fprintf(fp, "admin admin123 admin\n");
-        fprintf(fp, "student student123 student\n");
-        fclose(fp);
-        fp = fopen(USER_FILE, "r");
+        const char* defaults[][3] = { { "admin", "admin123", "admin" }, { "student", "student123", "student" } };
+        for (int i = 0; i < 2; i++) {
+            User* u = addUser(defaults[i][0]);
+            strcpy(u->role, defaults[i][2]);
+            randomSalt(u->salt);
+            hashPassword(u->salt, defaults[i][1], u->hash);
+        }
+        return saveUsers(path);
     }
 
+    int hashed = 0, first = 1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (first) {
+            first = 0;
+            if (strncmp(line, USERS_HEADER, strlen(USERS_HEADER)) == 0 &&
+                (line[strlen(USERS_HEADER)] == '\n' || !line[strlen(USERS_HEADER)])) {
+                hashed = 1;
+                continue;
+            }
+        }
+        if (sscanf(line, "%49s %199s %19s", name, password, role) != 3)
+            continue;
+        User stored;
+        if (hashed && !parseStoredHash(password, &stored)) {
+            // Never fall back to reading it as plaintext
+            printf("%s: skipping '%s', whose password hash is malformed\n", path, name);
+            continue;
+        }
+        User* u = addUser(name);
+        strcpy(u->role, role);
+        if (hashed) {
+            memcpy(u->salt, stored.salt, SALT_BYTES);
+            memcpy(u->hash, stored.hash, 32);
+        } else {
+            randomSalt(u->salt);
+            hashPassword(u->salt, password, u->hash);
+        }
+    }
+    fclose(fp);
+    if (!hashed && userCount && !saveUsers(path))
+        printf("Could not rewrite %s with hashed passwords.\n", path);
+    return 1;
+}
+
+static unsigned int roleCapabilities(const char* role) {
+    if (strcmp(role, "admin") == 0)
+        return CAP_CIRCULATE | CAP_MANAGE_BOOKS | CAP_MANAGE_SECTIONS;
+    return CAP_CIRCULATE;
+}
+
+int login(Session* session) {
+    char username[50], password[50];
+    unsigned char hash[32];
+
     printf("\nEnter Username: ");
     fgets(username, 50, stdin);
     username[strcspn(username, "\n")] = 0;
@@ -176,18 +530,29 @@ int login(char* role) {
     fgets(password, 50, stdin);
     password[strcspn(password, "\n")] = 0;
 
-    while (fscanf(fp, "%s %s %s", fileUser, filePass, fileRole) != EOF) {
-        if (strcmp(username, fileUser) == 0 && strcmp(password, filePass) == 0) {
-            strcpy(role, fileRole);
-            fclose(fp);
-            printf("\nLogin successful! Role: %s\n", role);
-            return 1;
-        }
+    // Hash even for unknown users so the reply time doesn't reveal them
+    static const User nobody;
+    const User* u = findUser(username);
+    hashPassword(u ? u->salt : nobody.salt, password, hash);
+    unsigned char diff = u ? 0 : 1;
+    for (int i = 0; i < 32; i++)
+        diff |= hash[i] ^ (u ? u->hash[i] : nobody.hash[i]);
+
+    if (diff) {
+        printf("\nInvalid credentials!\n");
+        return 0;
     }
+    strcpy(session->name, u->name);
+    strcpy(session->role, u->role);
+    session->caps = roleCapabilities(u->role);
+    printf("\nLogin successful! Role: %s\n", session->role);
+    return 1;
+}
 
-    fclose(fp);
-    printf("\nInvalid credentials!\n");
-    return 0;
+void freeUsers(void) {
+    free(users);
+    users = NULL;
+    userCapacity = userCount = 0;
 }
 
 // --- MAIN FUNCTION ---
@@ -196,10 +561,11 @@ int main() {
     int choice;
     char secName[50], title[50], author[50];
     int id;
-    char role[20];
+    Session session;
 
-    if (!login(role)) {
+    if (!loadUsers(USER_FILE) || !login(&session)) {
         printf("Exiting program.\n");
+        freeUsers();
         return 0;
     }
 
@@ -216,7 +582,7 @@ int main() {
 
         switch (choice) {
             case 1:
-                if (strcmp(role, "admin") != 0) {
+                if (!(session.caps & CAP_MANAGE_SECTIONS)) {
                     printf("Access denied! Admin only.\n");
                     break;
                 }
@@ -228,7 +594,7 @@ int main() {
                 break;
 
             case 2:
-                if (strcmp(role, "admin") != 0) {
+                if (!(session.caps & CAP_MANAGE_SECTIONS)) {
                     printf("Access denied! Admin only.\n");
                     break;
                 }
@@ -244,7 +610,7 @@ int main() {
                 break;
 
             case 4:
-                if (strcmp(role, "admin") != 0) {
+                if (!(session.caps & CAP_MANAGE_BOOKS)) {
                     printf("Access denied! Admin only.\n");
                     break;
                 }
@@ -270,7 +636,7 @@ int main() {
                 break;
 
             case 5:
-                if (strcmp(role, "admin") != 0) {
+                if (!(session.caps & CAP_MANAGE_BOOKS)) {
                     printf("Access denied! Admin only.\n");
                     break;
                 }
@@ -302,6 +668,10 @@ int main() {
                 break;
 
             case 7:
+                if (!(session.caps & CAP_CIRCULATE)) {
+                    printf("Access denied!\n");
+                    break;
+                }
                 printf("Enter Section Name: ");
                 fgets(secName, 50, stdin);
                 secName[strcspn(secName, "\n")] = 0;
@@ -319,6 +689,10 @@ int main() {
                 break;
 
             case 8:
+                if (!(session.caps & CAP_CIRCULATE)) {
+                    printf("Access denied!\n");
+                    break;
+                }
                 printf("Enter Section Name: ");
                 fgets(secName, 50, stdin);
                 secName[strcspn(secName, "\n")] = 0;
@@ -348,6 +722,7 @@ int main() {
     // Free memory
     while (library)
         library = deleteSection(library, library->name);
+    freeUsers();
 
     return 0;
 }
@@ -0,0 +1,842 @@
+// Catalog daemon: serves the Librabry.c catalog to local clients over a
+// Unix domain socket or a loopback TCP port, plus a load generator.
+//
+// Build and run:
+//   gcc -O2 -pthread server.c -o server
+//   ./server --listen unix:/tmp/library.sock [--threads N] [--snapshot <file>] [--wal <file>]
+//            [--wal-sync <n>] [--wal-sync-ms <ms>]
+//   ./server --load unix:/tmp/library.sock [--connections C] [--requests N]
+//            [--pipeline P] [--books B]
+//
+// Addresses are unix:<path> or tcp:<port> (always bound to 127.0.0.1).
+//
+// Protocol: every message is a uint32 length followed by that many bytes,
+// all integers in native byte order (clients are on the same machine).
+//   request:  u8 op | i32 id | up to three strings (u8 length + bytes)
+//   response: u8 status | payload
+// Requests on one connection may be pipelined; responses come back in order.
+// A connection whose unsent responses pass OUT_HIGH_WATER is not read
+// from until the client has taken them.
+
+#define _GNU_SOURCE // accept4
+#define LIBRARY_NO_MAIN
+#include "Librabry.c"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// --- Protocol ---
+enum {
+    OP_ADD_SECTION = 1,   // s1 = name
+    OP_DELETE_SECTION,    // s1 = name
+    OP_ADD,               // id, s1 = section, s2 = title, s3 = author
+    OP_DELETE,            // id
+    OP_ISSUE,             // id
+    OP_RETURN,            // id [, borrower]
+    OP_MOVE,              // id, s1 = from, s2 = to
+    OP_LIST,              // s1 = section
+    OP_RESERVE,           // id, s1 = patron
+    OP_HOLD_POSITION,     // id, s1 = patron
+    OP_CANCEL_HOLD        // id, s1 = patron
+};
+
+enum {
+    STATUS_OK = 0,
+    STATUS_FAILED,        // book or section not found, or wrong state
+    STATUS_BAD_REQUEST,
+    STATUS_HELD           // RETURN: the copy went to the next patron on hold
+};
+
+// LIST payload: u32 count, then per copy i32 id | u8 issued | title | author
+// RESERVE and HOLD_POSITION payload: i32 place in the hold queue
+// (RESERVE: 0 = issued now; HOLD_POSITION: 0 = not waiting)
+
+#define MAX_REQUEST 1024      // requests are small; anything bigger is bogus
+#define READ_CHUNK (64 * 1024)
+#define IN_LIMIT (4 * READ_CHUNK)           // unanswered requests buffered per connection
+#define OUT_HIGH_WATER (1024 * 1024)        // unsent bytes that stop a connection's requests
+#define LIST_MAX (64 * 1024 * 1024)         // largest LIST answer; bigger ones fail
+
+static size_t putStr(unsigned char* p, const char* str)
+{
+    size_t len = strlen(str);
+    p[0] = (unsigned char)len;
+    memcpy(p + 1, str, len);
+    return len + 1;
+}
+
+static const unsigned char* getStr(const unsigned char* p, const unsigned char* end, char out[50])
+{
+    if(p >= end || p + 1 + *p > end || *p > 49)
+        return NULL;
+    memcpy(out, p + 1, *p);
+    out[*p] = 0;
+    return p + 1 + *p;
+}
+
+// Frame a request into buf; returns its total size including the length
+static size_t encodeRequest(unsigned char* buf, int op, int id, const char* s1, const char* s2, const char* s3)
+{
+    unsigned char* p = buf + 4;
+    *p++ = (unsigned char)op;
+    int32_t id32 = id;
+    memcpy(p, &id32, 4);
+    p += 4;
+    if(s1) p += putStr(p, s1);
+    if(s2) p += putStr(p, s2);
+    if(s3) p += putStr(p, s3);
+    uint32_t len = (uint32_t)(p - buf - 4);
+    memcpy(buf, &len, 4);
+    return (size_t)(p - buf);
+}
+
+// Fills in a sockaddr for unix:<path> or tcp:<port>; returns its family or -1
+static int parseAddress(const char* addr, struct sockaddr_storage* ss, socklen_t* len)
+{
+    memset(ss, 0, sizeof(*ss));
+    if(strncmp(addr, "unix:", 5) == 0) {
+        struct sockaddr_un* un = (struct sockaddr_un*)ss;
+        if(strlen(addr + 5) >= sizeof(un->sun_path))
+            return -1;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, addr + 5);
+        *len = sizeof(*un);
+        return AF_UNIX;
+    }
+    if(strncmp(addr, "tcp:", 4) == 0) {
+        struct sockaddr_in* in = (struct sockaddr_in*)ss;
+        int port = atoi(addr + 4);
+        if(port <= 0 || port > 65535)
+            return -1;
+        in->sin_family = AF_INET;
+        in->sin_port = htons((uint16_t)port);
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        *len = sizeof(*in);
+        return AF_INET;
+    }
+    return -1;
+}
+
+// --- Server ---
+
+typedef struct Conn
+{
+    int fd;
+    unsigned char* in;
+    size_t inUsed;
+    size_t inCap;
+    unsigned char* out;
+    size_t outUsed;
+    size_t outSent;
+    size_t outCap;
+    uint32_t events;      // epoll interest currently registered
+} Conn;
+
+typedef struct ServerLoop
+{
+    int listenFd;
+    pthread_t thread;
+} ServerLoop;
+
+static int stopping;  // set by the main thread once SIGINT/SIGTERM arrives
+
+static unsigned char* outReserve(Conn* c, size_t n)
+{
+    if(c->outUsed + n > c->outCap) {
+        size_t cap = c->outCap ? c->outCap : 4096;
+        while(cap < c->outUsed + n)
+            cap *= 2;
+        c->out = (unsigned char*)realloc(c->out, cap);
+        if(!c->out) {
+            printf("Out of memory while buffering a response!\n");
+            exit(1);
+        }
+        c->outCap = cap;
+    }
+    return c->out + c->outUsed;
+}
+
+// LIST: every copy of every book in a section, read under the
+// section's shared lock. An answer that would pass LIST_MAX is
+// dropped and the request fails instead.
+static void listSection(Conn* c, const char* name)
+{
+    pthread_rwlock_rdlock(&catalogLock);
+    Section* sec = sectionNamed(name);
+    if(!sec) {
+        pthread_rwlock_unlock(&catalogLock);
+        *outReserve(c, 1) = STATUS_FAILED;
+        c->outUsed++;
+        return;
+    }
+    pthread_rwlock_rdlock(&sec->lock);
+    size_t body = c->outUsed;
+    unsigned char* p = outReserve(c, 5);
+    p[0] = STATUS_OK;
+    uint32_t count = (uint32_t)sec->copyCount;
+    memcpy(p + 1, &count, 4);
+    c->outUsed += 5;
+    for(Book* b = sec->books; b && c->outUsed - body <= LIST_MAX; b = b->next) {
+        int shelf = columnOnShelf(sec, b->col);
+        for(int copy = 0; copy < columnCopies(sec, b->col); copy++) {
+            p = outReserve(c, 5 + 2 * 50);
+            int32_t id = b->id;
+            memcpy(p, &id, 4);
+            p[4] = (unsigned char)(copy >= shelf);
+            size_t n = 5;
+            n += putStr(p + n, b->title);
+            n += putStr(p + n, b->author);
+            c->outUsed += n;
+        }
+    }
+    if(c->outUsed - body > LIST_MAX) {
+        c->outUsed = body;
+        *outReserve(c, 1) = STATUS_FAILED;
+        c->outUsed++;
+    }
+    pthread_rwlock_unlock(&sec->lock);
+    pthread_rwlock_unlock(&catalogLock);
+}
+
+// Decode one request and append its framed response to c->out
+static void handleRequest(Conn* c, const unsigned char* msg, uint32_t len)
+{
+    size_t start = c->outUsed;
+    outReserve(c, 4);
+    c->outUsed += 4; // length, patched below
+
+    const unsigned char* end = msg + len;
+    char s[3][50] = { "", "", "" };
+    int strings = 0, status = STATUS_BAD_REQUEST;
+    int32_t id = 0;
+    if(len >= 5) {
+        memcpy(&id, msg + 1, 4);
+        const unsigned char* p = msg + 5;
+        while(p && p < end && strings < 3)
+            p = getStr(p, end, s[strings++]);
+        if(!p || p != end)
+            strings = -1;
+    }
+
+    if(strings >= 0 && len >= 5) {
+        Section* sec;
+        switch(msg[0]) {
+            case OP_ADD_SECTION:
+                if(strings == 1 && s[0][0])
+                    status = addSection(NULL, s[0]) ? STATUS_OK : STATUS_FAILED;
+                break;
+            case OP_DELETE_SECTION:
+                if(strings == 1) {
+                    // Look up and delete under one lock, so the status
+                    // can't race another client's delete
+                    pthread_rwlock_wrlock(&catalogLock);
+                    status = removeSection(s[0]) ? STATUS_OK : STATUS_FAILED;
+                    pthread_rwlock_unlock(&catalogLock);
+                }
+                break;
+            case OP_ADD:
+                if(strings == 3) {
+                    // Look the section up and use it under one catalog
+                    // lock, so another client can't delete it in between
+                    pthread_rwlock_rdlock(&catalogLock);
+                    sec = sectionNamed(s[0]);
+                    if(sec)
+                        addBookTo(sec, id, s[1], s[2]);
+                    pthread_rwlock_unlock(&catalogLock);
+                    status = sec ? STATUS_OK : STATUS_FAILED;
+                }
+                break;
+            case OP_DELETE:
+                if(strings == 0)
+                    status = deleteBookById(id) ? STATUS_OK : STATUS_FAILED;
+                break;
+            case OP_ISSUE:
+                if(strings == 0)
+                    status = issueBookById(id) ? STATUS_OK : STATUS_FAILED;
+                break;
+            case OP_RETURN:
+                if(strings <= 1) {
+                    int r = returnBookFrom(NULL, id, strings ? s[0] : NULL);
+                    status = r == 2 ? STATUS_HELD : r ? STATUS_OK : STATUS_FAILED;
+                }
+                break;
+            case OP_MOVE:
+                if(strings == 2) {
+                    pthread_rwlock_rdlock(&catalogLock);
+                    Section* from = sectionNamed(s[0]);
+                    Section* to = sectionNamed(s[1]);
+                    status = from && to && moveBookTo(from, to, id) ? STATUS_OK : STATUS_FAILED;
+                    pthread_rwlock_unlock(&catalogLock);
+                }
+                break;
+            case OP_LIST:
+                if(strings == 1) {
+                    listSection(c, s[0]);
+                    status = -1; // listSection wrote the body
+                }
+                break;
+            case OP_RESERVE:
+            case OP_HOLD_POSITION:
+                if(strings == 1) {
+                    int32_t place = msg[0] == OP_RESERVE ? reserveBook(id, s[0]) : holdPosition(id, s[0]);
+                    unsigned char* p = outReserve(c, 5);
+                    p[0] = place < 0 ? STATUS_FAILED : STATUS_OK;
+                    memcpy(p + 1, &place, 4);
+                    c->outUsed += place < 0 ? 1 : 5;
+                    status = -1;
+                }
+                break;
+            case OP_CANCEL_HOLD:
+                if(strings == 1)
+                    status = cancelHold(id, s[0]) ? STATUS_OK : STATUS_FAILED;
+                break;
+        }
+    }
+    if(status >= 0) {
+        *outReserve(c, 1) = (unsigned char)status;
+        c->outUsed++;
+    }
+    uint32_t bodyLen = (uint32_t)(c->outUsed - start - 4);
+    memcpy(c->out + start, &bodyLen, 4);
+}
+
+static void closeConn(int ep, Conn* c)
+{
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+// Send what the socket takes. A buffer that grew past the high-water
+// mark for one big answer is given back once it drains.
+static int flushConn(Conn* c)
+{
+    while(c->outSent < c->outUsed) {
+        ssize_t n = send(c->fd, c->out + c->outSent, c->outUsed - c->outSent, MSG_NOSIGNAL);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                return 0;
+            break;
+        }
+        c->outSent += (size_t)n;
+    }
+    if(c->outSent == c->outUsed) {
+        c->outSent = c->outUsed = 0;
+        if(c->outCap > OUT_HIGH_WATER) {
+            free(c->out);
+            c->out = NULL;
+            c->outCap = 0;
+        }
+    }
+    return 1;
+}
+
+// Read what is available, up to IN_LIMIT bytes buffered
+static int readConn(Conn* c)
+{
+    if(!c->inCap) {
+        c->in = (unsigned char*)malloc(IN_LIMIT);
+        if(!c->in) {
+            printf("Out of memory while reading a request!\n");
+            exit(1);
+        }
+        c->inCap = IN_LIMIT;
+    }
+    while(c->inUsed < c->inCap) {
+        ssize_t n = recv(c->fd, c->in + c->inUsed, c->inCap - c->inUsed, 0);
+        if(n == 0)
+            return 0;
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return 0;
+        }
+        c->inUsed += (size_t)n;
+    }
+    return 1;
+}
+
+static int outBacklogged(const Conn* c)
+{
+    return c->outUsed - c->outSent >= OUT_HIGH_WATER;
+}
+
+// Answer the complete requests in c->in until the unsent responses reach
+// OUT_HIGH_WATER. Returns -1 on a malformed frame, else whether a whole
+// request is still waiting.
+static int serveRequests(Conn* c)
+{
+    size_t off = 0;
+    int waiting = 0;
+    while(c->inUsed - off >= 4) {
+        uint32_t len;
+        memcpy(&len, c->in + off, 4);
+        if(len > MAX_REQUEST)
+            return -1;
+        if(c->inUsed - off - 4 < len)
+            break;
+        if(outBacklogged(c)) {
+            waiting = 1;
+            break;
+        }
+        handleRequest(c, c->in + off + 4, len);
+        off += 4 + len;
+    }
+    memmove(c->in, c->in + off, c->inUsed - off);
+    c->inUsed -= off;
+    return waiting;
+}
+
+// Answer and send until neither makes progress, then watch for input
+// only while the backlog is under the high-water mark and for output
+// only while some is left
+static int pumpConn(int ep, Conn* c)
+{
+    int waiting;
+    do {
+        if((waiting = serveRequests(c)) < 0 || !flushConn(c))
+            return 0;
+    } while(waiting && !outBacklogged(c));
+
+    uint32_t events = (outBacklogged(c) ? 0 : EPOLLIN) | (c->outSent < c->outUsed ? EPOLLOUT : 0);
+    if(events != c->events) {
+        struct epoll_event ev = { events, { .ptr = c } };
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+    return 1;
+}
+
+static void acceptAll(int ep, int listenFd)
+{
+    for(;;) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+            return; // EAGAIN: another loop got it, or none left
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on unix sockets
+        Conn* c = (Conn*)calloc(1, sizeof(Conn));
+        if(!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        struct epoll_event ev = { EPOLLIN, { .ptr = c } };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+// One event loop per thread; all loops share the listening socket and
+// the kernel wakes only one of them per new connection
+static void* serveLoop(void* arg)
+{
+    ServerLoop* loop = (ServerLoop*)arg;
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { EPOLLIN | EPOLLEXCLUSIVE, { .ptr = NULL } };
+    epoll_ctl(ep, EPOLL_CTL_ADD, loop->listenFd, &ev);
+
+    struct epoll_event events[64];
+    while(!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        int n = epoll_wait(ep, events, 64, wal.syncMs > 0 ? wal.syncMs : 100);
+        if(n <= 0) {
+            walCommit(); // idle: don't leave a group waiting for more records
+            continue;
+        }
+        for(int i = 0; i < n; i++) {
+            Conn* c = (Conn*)events[i].data.ptr;
+            if(!c) {
+                acceptAll(ep, loop->listenFd);
+                continue;
+            }
+            int ok = 1;
+            if((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && !outBacklogged(c))
+                ok = readConn(c);
+            if(ok)
+                ok = pumpConn(ep, c);
+            if(!ok)
+                closeConn(ep, c);
+        }
+    }
+    // Open connections are dropped on shutdown; their Conn memory goes
+    // with the process
+    close(ep);
+    return NULL;
+}
+
+static int listenOn(const char* addr)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+    int family = parseAddress(addr, &ss, &len);
+    if(family < 0) {
+        fprintf(stderr, "Bad address '%s' (use unix:<path> or tcp:<port>)\n", addr);
+        return -1;
+    }
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    int one = 1;
+    if(family == AF_UNIX)
+        unlink(((struct sockaddr_un*)&ss)->sun_path); // stale socket from a previous run
+    else
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(bind(fd, (struct sockaddr*)&ss, len) != 0 || listen(fd, 512) != 0) {
+        perror(addr);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int runServer(const char* addr, int threads, const char* snapshotPath, const char* walPath)
+{
+    Section* library = NULL;
+    if(snapshotPath)
+        library = loadSnapshot(library, snapshotPath);
+    if(walPath) {
+        library = replayWal(library, walPath);
+        if(!walOpen(walPath)) {
+            perror(walPath);
+            return 1;
+        }
+    }
+
+    int listenFd = listenOn(addr);
+    if(listenFd < 0)
+        return 1;
+    // Loops inherit a mask blocking the stop signals; only the main thread
+    // takes them, then tells the loops to finish
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Serving %ld books on %s with %d thread(s)\n", libraryStats().books, addr, threads);
+
+    ServerLoop* loops = (ServerLoop*)calloc((size_t)threads, sizeof(ServerLoop));
+    for(int i = 0; i < threads; i++) {
+        loops[i].listenFd = listenFd;
+        pthread_create(&loops[i].thread, NULL, serveLoop, &loops[i]);
+    }
+    int sig;
+    sigwait(&stopSignals, &sig);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+    for(int i = 0; i < threads; i++)
+        pthread_join(loops[i].thread, NULL);
+    free(loops);
+    close(listenFd);
+    if(strncmp(addr, "unix:", 5) == 0)
+        unlink(addr + 5);
+
+    fprintf(stderr, "Shutting down\n");
+    if(snapshotPath && !saveSnapshot(library, snapshotPath))
+        fprintf(stderr, "Could not save snapshot to '%s'\n", snapshotPath);
+    freeLibrary(sectionList);
+    return 0;
+}
+
+// --- Load Generator ---
+// Each connection keeps `pipeline` requests in flight and times every
+// request from send to response.
+
+#define LOAD_SECTION "load-generator"
+#define LOAD_ID_BASE 1000000000
+
+typedef struct LoadWorker
+{
+    const char* addr;
+    long requests;
+    int pipeline;
+    long books;
+    unsigned long long rng;
+    long long* latency;   // ns per request
+    long errors;
+    pthread_t thread;
+} LoadWorker;
+
+static long long nowNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static int connectTo(const char* addr)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+    int family = parseAddress(addr, &ss, &len);
+    if(family < 0)
+        return -1;
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, (struct sockaddr*)&ss, len) != 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int sendAll(int fd, const unsigned char* p, size_t n)
+{
+    while(n) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if(w <= 0) {
+            if(w < 0 && errno == EINTR)
+                continue;
+            return 0;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+// Buffered reader for responses
+typedef struct Reader
+{
+    int fd;
+    unsigned char buf[READ_CHUNK];
+    size_t used;
+    size_t off;
+} Reader;
+
+static int readExact(Reader* r, unsigned char* out, size_t n)
+{
+    while(n) {
+        if(r->off == r->used) {
+            ssize_t got = recv(r->fd, r->buf, sizeof(r->buf), 0);
+            if(got <= 0) {
+                if(got < 0 && errno == EINTR)
+                    continue;
+                return 0;
+            }
+            r->used = (size_t)got;
+            r->off = 0;
+        }
+        size_t take = r->used - r->off < n ? r->used - r->off : n;
+        if(out) {
+            memcpy(out, r->buf + r->off, take);
+            out += take;
+        }
+        r->off += take;
+        n -= take;
+    }
+    return 1;
+}
+
+// Reads one response; returns its status, or -1 if the connection broke
+static int readResponse(Reader* r)
+{
+    uint32_t len;
+    unsigned char status;
+    if(!readExact(r, (unsigned char*)&len, 4) || len < 1 || !readExact(r, &status, 1) ||
+       !readExact(r, NULL, len - 1))
+        return -1;
+    return status;
+}
+
+static void* loadWorker(void* arg)
+{
+    LoadWorker* w = (LoadWorker*)arg;
+    Reader* r = (Reader*)calloc(1, sizeof(Reader));
+    long long* sentAt = (long long*)malloc(sizeof(long long) * (size_t)w->pipeline);
+    unsigned char req[64];
+    r->fd = connectTo(w->addr);
+    if(r->fd < 0) {
+        w->errors = w->requests;
+        free(sentAt);
+        free(r);
+        return NULL;
+    }
+
+    long sent = 0, done = 0;
+    while(done < w->requests) {
+        // Top up the pipeline, then wait for the oldest response
+        while(sent < w->requests && sent - done < w->pipeline) {
+            w->rng ^= w->rng << 13;
+            w->rng ^= w->rng >> 7;
+            w->rng ^= w->rng << 17;
+            int id = LOAD_ID_BASE + (int)((w->rng >> 1) % (unsigned long long)w->books);
+            size_t n = encodeRequest(req, (w->rng & 1) ? OP_ISSUE : OP_RETURN, id, NULL, NULL, NULL);
+            sentAt[sent % w->pipeline] = nowNs();
+            if(!sendAll(r->fd, req, n))
+                break;
+            sent++;
+        }
+        if(readResponse(r) < 0)
+            break;
+        w->latency[done] = nowNs() - sentAt[done % w->pipeline];
+        done++;
+    }
+    w->errors += w->requests - done;
+    w->requests = done;
+    close(r->fd);
+    free(sentAt);
+    free(r);
+    return NULL;
+}
+
+static int compareLongLong(const void* a, const void* b)
+{
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Sends one request on a plain connection and waits for its status
+static int roundTrip(int fd, Reader* r, int op, int id, const char* s1, const char* s2, const char* s3)
+{
+    unsigned char req[256];
+    size_t n = encodeRequest(req, op, id, s1, s2, s3);
+    return sendAll(fd, req, n) ? readResponse(r) : -1;
+}
+
+static int runLoad(const char* addr, int connections, long requests, int pipeline, long books)
+{
+    // Seed a section of books to circulate, pipelined on one connection
+    Reader* setup = (Reader*)calloc(1, sizeof(Reader));
+    setup->fd = connectTo(addr);
+    if(setup->fd < 0) {
+        fprintf(stderr, "Could not connect to %s\n", addr);
+        free(setup);
+        return 1;
+    }
+    long long start = nowNs();
+    roundTrip(setup->fd, setup, OP_DELETE_SECTION, 0, LOAD_SECTION, NULL, NULL);
+    if(roundTrip(setup->fd, setup, OP_ADD_SECTION, 0, LOAD_SECTION, NULL, NULL) != STATUS_OK) {
+        fprintf(stderr, "Server refused to add section '%s'\n", LOAD_SECTION);
+        close(setup->fd);
+        free(setup);
+        return 1;
+    }
+    unsigned char* batch = (unsigned char*)malloc(64 * 1024);
+    for(long i = 0; i < books; ) {
+        size_t used = 0;
+        long first = i;
+        for(; i < books && used < 60 * 1024; i++) {
+            char title[50];
+            snprintf(title, sizeof(title), "Load test title %ld", i);
+            used += encodeRequest(batch + used, OP_ADD, LOAD_ID_BASE + (int)i, LOAD_SECTION, title, "Load Generator");
+        }
+        sendAll(setup->fd, batch, used);
+        for(long k = first; k < i; k++)
+            readResponse(setup);
+    }
+    free(batch);
+    double addSecs = (nowNs() - start) / 1e9;
+    printf("Added %ld books in %.2f s (%.0f requests/s, pipelined)\n", books, addSecs, books / addSecs);
+
+    LoadWorker* workers = (LoadWorker*)calloc((size_t)connections, sizeof(LoadWorker));
+    long perWorker = requests / connections;
+    start = nowNs();
+    for(int i = 0; i < connections; i++) {
+        workers[i].addr = addr;
+        workers[i].requests = perWorker;
+        workers[i].pipeline = pipeline;
+        workers[i].books = books;
+        workers[i].rng = 0x9E3779B97F4A7C15ULL * (unsigned long long)(i + 1);
+        workers[i].latency = (long long*)malloc(sizeof(long long) * (size_t)perWorker);
+        pthread_create(&workers[i].thread, NULL, loadWorker, &workers[i]);
+    }
+    long total = 0, errors = 0;
+    for(int i = 0; i < connections; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].requests;
+        errors += workers[i].errors;
+    }
+    double secs = (nowNs() - start) / 1e9;
+
+    long long* all = (long long*)malloc(sizeof(long long) * (size_t)(total ? total : 1));
+    long k = 0;
+    for(int i = 0; i < connections; i++) {
+        memcpy(all + k, workers[i].latency, sizeof(long long) * (size_t)workers[i].requests);
+        k += workers[i].requests;
+        free(workers[i].latency);
+    }
+    qsort(all, (size_t)total, sizeof(long long), compareLongLong);
+    printf("Issue/return: %d connections x pipeline %d, %ld requests in %.2f s\n",
+           connections, pipeline, total, secs);
+    if(total)
+        printf("  %.0f requests/s   p50 %lld ns   p99 %lld ns   p99.9 %lld ns   max %lld ns\n",
+               total / secs, all[total / 2], all[total * 99 / 100], all[total * 999 / 1000], all[total - 1]);
+    if(errors)
+        printf("  %ld requests failed (connection errors)\n", errors);
+
+    // Leave the catalog as we found it
+    roundTrip(setup->fd, setup, OP_DELETE_SECTION, 0, LOAD_SECTION, NULL, NULL);
+    close(setup->fd);
+    free(setup);
+    free(all);
+    free(workers);
+    return errors ? 2 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* listenAddr = NULL;
+    const char* loadAddr = NULL;
+    const char* snapshotPath = NULL;
+    const char* walPath = NULL;
+    int threads = 1, connections = 4, pipeline = 16;
+    long requests = 1000000, books = 100000;
+
+    for(int i = 1; i < argc; i++) {
+        int ok = i + 1 < argc;
+        if(ok && strcmp(argv[i], "--listen") == 0)
+            listenAddr = argv[++i];
+        else if(ok && strcmp(argv[i], "--load") == 0)
+            loadAddr = argv[++i];
+        else if(ok && strcmp(argv[i], "--threads") == 0)
+            ok = (threads = atoi(argv[++i])) > 0;
+        else if(ok && strcmp(argv[i], "--snapshot") == 0)
+            snapshotPath = argv[++i];
+        else if(ok && strcmp(argv[i], "--wal") == 0)
+            walPath = argv[++i];
+        else if(ok && strcmp(argv[i], "--wal-sync") == 0)
+            ok = (wal.syncEvery = atoi(argv[++i])) > 0;
+        else if(ok && strcmp(argv[i], "--wal-sync-ms") == 0)
+            wal.syncMs = atoi(argv[++i]); // -1 turns the timer off, as in Librabry.c
+        else if(ok && strcmp(argv[i], "--connections") == 0)
+            ok = (connections = atoi(argv[++i])) > 0;
+        else if(ok && strcmp(argv[i], "--requests") == 0)
+            ok = (requests = atol(argv[++i])) > 0;
+        else if(ok && strcmp(argv[i], "--pipeline") == 0)
+            ok = (pipeline = atoi(argv[++i])) > 0;
+        else if(ok && strcmp(argv[i], "--books") == 0)
+            ok = (books = atol(argv[++i])) > 0 && books < 1000000000L;
+        else
+            ok = 0;
+
+        if(!ok || (listenAddr && loadAddr)) {
+            fprintf(stderr, "Usage: %s --listen <unix:path|tcp:port> [--threads N] [--snapshot <file>]\n"
+                            "          [--wal <file>] [--wal-sync <n>] [--wal-sync-ms <ms>]\n"
+                            "       %s --load <unix:path|tcp:port> [--connections C] [--requests N]\n"
+                            "          [--pipeline P] [--books B]\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    if(listenAddr)
+        return runServer(listenAddr, threads, snapshotPath, walPath);
+    if(loadAddr)
+        return runLoad(loadAddr, connections, requests, pipeline, books);
+    fprintf(stderr, "Nothing to do: pass --listen or --load\n");
+    return 1;
+}